@@ -23,6 +23,9 @@ struct Testcases {
 struct CompilerItem {
   std::string ext;
   std::string cmd;
+  // seccomp profile under ActiveSecurity ("native", "runtime" or "none");
+  // empty picks one from the extension
+  std::string security;
 };
 
 struct CompilerConfiguration {
@@ -43,6 +46,46 @@ struct Environment {
   std::string lastContestantDir; // unused
   int examEditAction = 0;        // unused
   bool toolBarVisible = false;   // unused
+  // judge by retired instructions instead of CPU time (Linux, needs
+  // hardware perf counters); the time limit is converted with
+  // instructionsPerSecond, which should be calibrated per judging machine
+  bool countInstructions = false;
+  double instructionsPerSecond = 1e9;
+  // exclusive cores for test runs: "none", "physical" (SMT siblings of a
+  // busy core stay idle) or "logical"; see CoreAllocator.h
+  std::string corePolicy = "none";
+  // seconds a test run may use no CPU at all before it is stopped as idle
+  // (ILE) instead of running into the wall-clock limit; 0 disables
+  float idleLimit = 0;
+  // pids.max of a test run's cgroup leaf, 0 for no limit. The kernel counts
+  // threads, not processes: a JVM or a threaded runtime needs some room.
+  // Compiler runs get compileMaxProcesses (javac and parallel linkers start
+  // a thread per core), unlimited by default
+  int maxProcesses = 64;
+  int compileMaxProcesses = 0;
+  // MiB of tmpfs per submission working directory (a full disk becomes the
+  // contestant's problem); 0 keeps plain directories. See WorkdirPool.h
+  int workdirQuota = 0;
+  // subtests of one submission that run at the same time, each in its own
+  // copy of the workdir; 1 runs them one after another
+  int parallelSubtests = 1;
+  // reuse the outcome of compiling an identical source with the same
+  // command and compiler (judgeCACHE in the contest house). Off by default:
+  // a compiler wrapper script or a header changed on disk can't be seen
+  // from the key; see CompileCache.h
+  bool compileCache = false;
+  // evaluators run in this many helper processes (POSIX; see CheckerHost.h)
+  // so a crashing or hanging checker can't take the judger down; 0 calls
+  // them in-process. Each call gets checkerTimeLimit seconds, each host
+  // checkerMemoryLimit MiB
+  int checkerHosts = 0;
+  float checkerTimeLimit = 10;
+  int checkerMemoryLimit = 1024;
+  // digest sidecars of the expected outputs of problems checked by the
+  // built-in C1/C2, built at startup under contestHouse/judgeCACHE/index;
+  // outputs are then checked against them instead of the answers, by hash
+  // only. See TokenIndex.h
+  bool tokenIndex = false;
 };
 struct Configuration {
   CompilerConfiguration compiler;
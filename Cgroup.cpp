@@ -0,0 +1,220 @@
+#include "Cgroup.h"
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#ifdef __linux__
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+std::string read_file(const fs::path &p) {
+  std::ifstream f(p);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  return ss.str();
+}
+
+bool write_file(const fs::path &p, std::string_view value) {
+  int fd = open(p.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  ssize_t w = write(fd, value.data(), value.size());
+  close(fd);
+  return w == (ssize_t)value.size();
+}
+
+bool has_word(const std::string &list, std::string_view word) {
+  std::istringstream ss(list);
+  std::string w;
+  while (ss >> w)
+    if (w == word)
+      return true;
+  return false;
+}
+
+// Value of `key` in a flat-keyed file such as memory.events
+uint64_t read_key(const fs::path &p, std::string_view key) {
+  std::istringstream ss(read_file(p));
+  std::string k;
+  uint64_t v;
+  while (ss >> k >> v)
+    if (k == key)
+      return v;
+  return 0;
+}
+
+fs::path find_cgroup2_mount() {
+  // mountinfo: id parent major:minor root mountpoint opts... - fstype ...
+  std::ifstream f("/proc/self/mountinfo");
+  std::string line;
+  while (std::getline(f, line)) {
+    auto sep = line.find(" - ");
+    if (sep == std::string::npos)
+      continue;
+    std::istringstream tail(line.substr(sep + 3));
+    std::string fstype;
+    tail >> fstype;
+    if (fstype != "cgroup2")
+      continue;
+    std::istringstream head(line.substr(0, sep));
+    std::string field;
+    for (int i = 0; i < 5 && head >> field; ++i)
+      ;
+    return field;
+  }
+  return {};
+}
+
+std::string own_cgroup() {
+  std::ifstream f("/proc/self/cgroup");
+  std::string line;
+  while (std::getline(f, line))
+    if (line.starts_with("0::"))
+      return line.substr(3);
+  return {};
+}
+
+// Directory that per-run leaves are created in, or empty if unusable
+fs::path runs_root() {
+  static fs::path root;
+  static std::once_flag once;
+  std::call_once(once, [] {
+    fs::path mnt = find_cgroup2_mount();
+    std::string own = own_cgroup();
+    if (mnt.empty() || own.empty())
+      return;
+
+    fs::path base = mnt / fs::path(own).relative_path();
+    auto controllers = read_file(base / "cgroup.controllers");
+    if (!has_word(controllers, "memory") || !has_word(controllers, "pids"))
+      return;
+
+    std::error_code ec;
+    if (base != mnt) {
+      fs::create_directory(base / "judger", ec);
+      if (ec || !write_file(base / "judger" / "cgroup.procs", "0"))
+        return;
+    }
+    if (!write_file(base / "cgroup.subtree_control", "+memory +pids"))
+      return;
+
+    fs::path runs = base / "oj-runs";
+    fs::create_directory(runs, ec);
+    if (ec || !write_file(runs / "cgroup.subtree_control", "+memory +pids"))
+      return;
+    root = runs;
+  });
+  return root;
+}
+} // namespace
+
+bool CgroupLeaf::init() { return !runs_root().empty(); }
+
+std::unique_ptr<CgroupLeaf> CgroupLeaf::create(uint64_t memoryBytes,
+                                               uint64_t maxPids) {
+  static std::atomic<uint64_t> counter{0};
+  fs::path root = runs_root();
+  if (root.empty())
+    return nullptr;
+
+  fs::path dir = root / ("run-" + std::to_string(getpid()) + "-" +
+                         std::to_string(counter++));
+  if (mkdir(dir.c_str(), 0755) < 0)
+    return nullptr;
+
+  int fd = open((dir / "cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+  std::unique_ptr<CgroupLeaf> leaf(new CgroupLeaf(dir, fd));
+  if (fd < 0)
+    return nullptr;
+
+  // memory.peak is only writable (for resets) since Linux 6.12
+  leaf->peak_fd_ = open((dir / "memory.peak").c_str(), O_RDWR | O_CLOEXEC);
+  if (leaf->peak_fd_ < 0)
+    leaf->peak_fd_ = open((dir / "memory.peak").c_str(), O_RDONLY | O_CLOEXEC);
+
+  // swap would let the run exceed the limit at the cost of the whole host
+  write_file(dir / "memory.swap.max", "0");
+  // without this, the OOM killer may pick only one task of the run
+  write_file(dir / "memory.oom.group", "1");
+  if (!leaf->set_limits(memoryBytes, maxPids))
+    return nullptr;
+  return leaf;
+}
+
+bool CgroupLeaf::set_limits(uint64_t memoryBytes, uint64_t maxPids) {
+  auto limit = [](uint64_t v) { return v ? std::to_string(v) : "max"; };
+  if (!write_file(dir_ / "memory.max", limit(memoryBytes)) && memoryBytes)
+    return false;
+  write_file(dir_ / "pids.max", limit(maxPids));
+  return true;
+}
+
+bool CgroupLeaf::reset_counters() {
+  oom_base_ = read_key(dir_ / "memory.events", "oom_kill");
+  return peak_fd_ >= 0 && write(peak_fd_, "reset", 5) == 5;
+}
+
+CgroupLeaf::~CgroupLeaf() {
+  if (procs_fd_ >= 0)
+    close(procs_fd_);
+  if (peak_fd_ >= 0)
+    close(peak_fd_);
+  kill();
+  // rmdir only succeeds once the killed tasks have been reaped
+  for (int i = 0; i < 100; ++i) {
+    if (rmdir(dir_.c_str()) == 0 || errno != EBUSY)
+      return;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+uint64_t CgroupLeaf::memory_peak_kb() const {
+  // Read through the same file that was reset, or the reset is not seen
+  char buf[32];
+  ssize_t n = peak_fd_ >= 0 ? pread(peak_fd_, buf, sizeof(buf) - 1, 0) : -1;
+  if (n <= 0)
+    return 0;
+  buf[n] = 0;
+  return std::strtoull(buf, nullptr, 10) / 1024;
+}
+
+uint64_t CgroupLeaf::cpu_usage_usec() const {
+  return read_key(dir_ / "cpu.stat", "usage_usec");
+}
+
+bool CgroupLeaf::oom_killed() const {
+  return read_key(dir_ / "memory.events", "oom_kill") > oom_base_;
+}
+
+void CgroupLeaf::kill() const {
+  if (write_file(dir_ / "cgroup.kill", "1"))
+    return;
+  // cgroup.kill is Linux >= 5.14; signal the members one by one instead
+  std::istringstream ss(read_file(dir_ / "cgroup.procs"));
+  pid_t pid;
+  while (ss >> pid)
+    ::kill(pid, SIGKILL);
+}
+#else
+bool CgroupLeaf::init() { return false; }
+std::unique_ptr<CgroupLeaf> CgroupLeaf::create(uint64_t, uint64_t) {
+  return nullptr;
+}
+CgroupLeaf::~CgroupLeaf() {}
+bool CgroupLeaf::set_limits(uint64_t, uint64_t) { return false; }
+bool CgroupLeaf::reset_counters() { return false; }
+uint64_t CgroupLeaf::memory_peak_kb() const { return 0; }
+uint64_t CgroupLeaf::cpu_usage_usec() const { return 0; }
+bool CgroupLeaf::oom_killed() const { return false; }
+void CgroupLeaf::kill() const {}
+#endif
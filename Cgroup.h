@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+namespace fs = std::filesystem;
+
+// One cgroup v2 leaf per run, created below the judger's own (delegated)
+// cgroup with the memory and pids controllers enabled.
+//
+// The first call moves main_judger into a "judger" leaf of its cgroup so that
+// the parent can delegate controllers (the no-internal-process rule), and
+// creates an "oj-runs" directory that holds the per-run leaves. Run it under
+// a delegated cgroup, e.g. `systemd-run --scope -p Delegate=yes main_judger`.
+class CgroupLeaf {
+public:
+  // nullptr when cgroup v2 with the memory and pids controllers is not
+  // usable; callers then fall back to setrlimit()/rusage
+  static std::unique_ptr<CgroupLeaf> create(uint64_t memoryBytes,
+                                            uint64_t maxPids);
+  // Does the one-time setup above now; false when cgroups are unusable.
+  // Call before starting long-lived helpers such as checker hosts, or they
+  // stay behind in the parent cgroup and keep controllers from being
+  // delegated
+  static bool init();
+  ~CgroupLeaf(); // kills whatever is left inside and removes the directory
+
+  CgroupLeaf(const CgroupLeaf &) = delete;
+  CgroupLeaf &operator=(const CgroupLeaf &) = delete;
+
+  // (Re)applies memory.max/pids.max; 0 lifts the limit
+  bool set_limits(uint64_t memoryBytes, uint64_t maxPids);
+  // Starts memory.peak and the OOM kill count from zero again, so the leaf
+  // can be reused for another run. Needs Linux >= 6.12 for the peak reset;
+  // false when unsupported
+  bool reset_counters();
+
+  // open O_WRONLY fd of cgroup.procs; a freshly forked child joins the leaf
+  // with write(fd, "0", 1) before exec
+  int procs_fd() const { return procs_fd_; }
+  const fs::path &path() const { return dir_; }
+
+  // memory.peak in KiB, 0 when the kernel doesn't provide it (< 5.19)
+  uint64_t memory_peak_kb() const;
+  // usage_usec of cpu.stat (available without the cpu controller), i.e. CPU
+  // time of everything that ever ran in the leaf
+  uint64_t cpu_usage_usec() const;
+  // true when the OOM killer fired inside this leaf (memory.events)
+  bool oom_killed() const;
+  // SIGKILLs every process in the leaf, grandchildren included
+  void kill() const;
+
+private:
+  CgroupLeaf(fs::path dir, int procs_fd)
+      : dir_(std::move(dir)), procs_fd_(procs_fd) {}
+
+  fs::path dir_;
+  int procs_fd_ = -1;
+  int peak_fd_ = -1;      // memory.peak; resets are per open file
+  uint64_t oom_base_ = 0; // oom_kill count at the last reset_counters()
+};
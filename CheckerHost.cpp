@@ -0,0 +1,308 @@
+#include "CheckerHost.h"
+#include "Cgroup.h"
+#include "JudgeAPI.h"
+#include "ProcessIO.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#ifndef _WIN32
+#include "Spawn.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr uint32_t kMagic = 0x31686a6f; // "ojh1"
+constexpr size_t kMaxMessage = 64 * 1024;
+constexpr int kRequestArgs = 8;
+
+// A request is the header followed by kRequestArgs NUL-terminated strings:
+// evaluator path, then contestantsDir, testsDir, testOutputs, testName,
+// input, expected and output of the CheckRequest. The reply is the header
+// followed by the comments (not terminated), or by the error message when
+// ok == 0.
+struct RequestHeader {
+  uint32_t magic;
+  uint32_t args;
+  double timeLimit, memoryLimit, timeUsed;
+  uint64_t memoryUsed;
+};
+
+struct ReplyHeader {
+  uint32_t magic;
+  int32_t ok;
+  double points;
+};
+} // namespace
+
+CheckerPool &CheckerPool::instance() {
+  static CheckerPool pool;
+  return pool;
+}
+
+#ifndef _WIN32
+CheckerPool::~CheckerPool() {
+  for (auto &host : hosts_)
+    if (host->pid >= 0)
+      stop(*host);
+}
+
+void CheckerPool::configure(int hosts, float timeLimit, uint64_t memoryBytes) {
+  std::error_code ec;
+  exe_ = fs::read_symlink("/proc/self/exe", ec).string();
+  if (ec || hosts <= 0)
+    return;
+  timeLimitMs_ = std::max(1, (int)(timeLimit * 1000));
+  memory_ = memoryBytes;
+  for (int i = 0; i < hosts; ++i) {
+    hosts_.push_back(std::make_unique<Host>());
+    idle_.push_back(hosts_.back().get());
+  }
+}
+
+void CheckerPool::start(Host &host) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+    throw CPError<CPErrors::IE>("checker host socketpair failed");
+  int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+  // Evaluators may print; their stdout must not end up in the judger's
+  char *argv[] = {exe_.data(), const_cast<char *>("--checker-host"), nullptr};
+  ChildSetup setup;
+  setup.stdin_fd = sv[1];
+  setup.stdout_fd = devnull;
+  setup.path = exe_.c_str();
+  setup.argv = argv;
+  host.cgroup = CgroupLeaf::create(memory_, 0);
+  if (host.cgroup)
+    setup.cgroup_procs_fd = host.cgroup->procs_fd();
+  else if (memory_)
+    setup.as = memory_;
+  pid_t pid = spawn_child(setup);
+  close(sv[1]);
+  if (devnull >= 0)
+    close(devnull);
+  if (pid < 0) {
+    close(sv[0]);
+    host.cgroup.reset();
+    throw CPError<CPErrors::IE>("cannot start checker host");
+  }
+  host.pid = pid;
+  host.sock = sv[0];
+}
+
+int CheckerPool::stop(Host &host) {
+  kill(host.pid, SIGKILL);
+  if (host.cgroup)
+    host.cgroup->kill(); // whatever the evaluator started
+  int status = 0;
+  while (waitpid(host.pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  close(host.sock);
+  host.pid = host.sock = -1;
+  host.cgroup.reset();
+  return status;
+}
+
+CheckerVerdict CheckerPool::judge(const fs::path &evaluator,
+                                  const CheckRequest &check) {
+  Host *host;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this] { return !idle_.empty(); });
+    host = idle_.back();
+    idle_.pop_back();
+  }
+  struct Return {
+    CheckerPool *pool;
+    Host *host;
+    ~Return() {
+      std::lock_guard<std::mutex> lock(pool->mutex_);
+      pool->idle_.push_back(host);
+      pool->idle_cv_.notify_one();
+    }
+  } give_back{this, host};
+
+  std::string request(sizeof(RequestHeader), '\0');
+  RequestHeader header{kMagic,           kRequestArgs,
+                       check.timeLimit,  check.memoryLimit,
+                       check.timeUsed,   check.memoryUsed};
+  std::memcpy(request.data(), &header, sizeof(header));
+  for (const std::string &arg :
+       {evaluator.string(), check.contestantsDir, check.testsDir,
+        check.testOutputs, check.testName, check.input.string(),
+        check.expected.string(), check.output.string()}) {
+    request += arg;
+    request += '\0';
+  }
+  if (request.size() > kMaxMessage)
+    throw CPError<CPErrors::IE>("checker request too long");
+
+  // A host that crashes, hangs or runs out of memory may have been left in
+  // a bad state by an earlier call (a leak, a corrupted heap); the call is
+  // retried once on a fresh host before it counts as the checker's fault
+  std::string failure;
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    CheckerVerdict verdict;
+    if (call(*host, request, verdict, failure))
+      return verdict;
+  }
+  throw CPError<CPErrors::IE>(failure + ", twice in a row");
+}
+
+bool CheckerPool::call(Host &host, const std::string &request,
+                       CheckerVerdict &verdict, std::string &failure) {
+  if (host.pid < 0)
+    start(host);
+  if (host.cgroup)
+    host.cgroup->reset_counters();
+  auto begin = std::chrono::steady_clock::now();
+  if (send(host.sock, request.data(), request.size(), MSG_NOSIGNAL) < 0) {
+    stop(host);
+    failure = "checker host is gone";
+    return false;
+  }
+
+  auto deadline = begin + std::chrono::milliseconds(timeLimitMs_);
+  pollfd pfd{host.sock, POLLIN, 0};
+  for (;;) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    int r = poll(&pfd, 1, std::max<int>(0, left.count()));
+    if (r > 0)
+      break;
+    if (r == 0) {
+      stop(host);
+      failure = "checker exceeded " + std::to_string(timeLimitMs_) + " ms";
+      return false;
+    }
+    if (errno != EINTR) {
+      stop(host);
+      failure = "poll on checker host failed";
+      return false;
+    }
+  }
+
+  std::vector<char> reply(kMaxMessage);
+  ssize_t n = recv(host.sock, reply.data(), reply.size(), 0);
+  verdict.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - begin)
+                        .count();
+  ReplyHeader result;
+  if (n < (ssize_t)sizeof(result)) {
+    // EOF: the host died in the middle of the call
+    bool oom = host.cgroup && host.cgroup->oom_killed();
+    int status = stop(host);
+    if (oom)
+      failure = "checker exceeded its memory limit";
+    else if (WIFSIGNALED(status))
+      failure = "checker killed by signal " + std::to_string(WTERMSIG(status));
+    else
+      failure = "checker host exited";
+    return false;
+  }
+  std::memcpy(&result, reply.data(), sizeof(result));
+  std::string text(reply.data() + sizeof(result), n - sizeof(result));
+  if (result.magic != kMagic) {
+    stop(host);
+    failure = "malformed checker reply";
+    return false;
+  }
+  // The evaluator itself failed (couldn't be loaded, ...): the same on any
+  // host
+  if (!result.ok)
+    throw CPError<CPErrors::IE>("checker: " + text);
+  if (host.cgroup)
+    verdict.memoryKb = host.cgroup->memory_peak_kb();
+  verdict.points = result.points;
+  verdict.comments = std::move(text);
+  return true;
+}
+
+int checker_host_main(int sock) {
+  // Exits once the judger closes its end. A judger that crashes or is
+  // killed closes it too, but an evaluator stuck in a call would keep the
+  // host and every library it loaded around forever: this thread ends the
+  // host as soon as the judger's end is gone, whatever the call is doing.
+  // (PR_SET_PDEATHSIG would fire when the judger thread that started the
+  // host exits, not the judger.)
+  std::thread([sock] {
+    pollfd pfd{sock, POLLRDHUP, 0};
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+      ;
+    _exit(0);
+  }).detach();
+
+  std::vector<char> buf(kMaxMessage + 1);
+  for (;;) {
+    ssize_t n = recv(sock, buf.data(), kMaxMessage, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return 0;
+    buf[n] = '\0';
+
+    RequestHeader header;
+    char *args[kRequestArgs] = {};
+    bool valid = n >= (ssize_t)sizeof(header);
+    if (valid) {
+      std::memcpy(&header, buf.data(), sizeof(header));
+      valid = header.magic == kMagic && header.args == kRequestArgs;
+    }
+    char *p = buf.data() + sizeof(header), *end = buf.data() + n;
+    for (int i = 0; valid && i < kRequestArgs; ++i) {
+      char *nul = std::find(p, end, '\0');
+      valid = nul != end;
+      args[i] = p;
+      p = nul + 1;
+    }
+
+    ReplyHeader reply{kMagic, 0, 0.0};
+    std::string text;
+    if (!valid) {
+      text = "malformed request";
+    } else {
+      CheckRequest check;
+      check.contestantsDir = args[1];
+      check.testsDir = args[2];
+      check.testOutputs = args[3];
+      check.testName = args[4];
+      check.input = args[5];
+      check.expected = args[6];
+      check.output = args[7];
+      check.timeLimit = header.timeLimit;
+      check.memoryLimit = header.memoryLimit;
+      check.timeUsed = header.timeUsed;
+      check.memoryUsed = header.memoryUsed;
+      try {
+        reply.points = call_evaluator(
+            EvaluatorRegistry::instance().get(args[0]), check, text);
+        reply.ok = 1;
+      } catch (const std::exception &e) {
+        text = e.what();
+      }
+    }
+    text.resize(std::min(text.size(), kMaxMessage - sizeof(reply)));
+    std::string message(sizeof(reply), '\0');
+    std::memcpy(message.data(), &reply, sizeof(reply));
+    message += text;
+    send(sock, message.data(), message.size(), MSG_NOSIGNAL);
+  }
+}
+#else
+CheckerPool::~CheckerPool() = default;
+
+void CheckerPool::configure(int, float, uint64_t) {}
+
+CheckerVerdict CheckerPool::judge(const fs::path &, const CheckRequest &) {
+  throw CPError<CPErrors::IE>("checker hosts are not supported on Windows");
+}
+
+int checker_host_main(int) { return 1; }
+#endif
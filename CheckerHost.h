@@ -0,0 +1,78 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+class CgroupLeaf;
+struct CheckRequest;
+
+// What an evaluator said about one subtest, and what checking it cost
+struct CheckerVerdict {
+  double points = 0.0;
+  std::string comments;
+  double seconds = 0.0;   // wall time of the Judge() call
+  uint64_t memoryKb = 0;  // host's peak during the call; 0 when unknown
+};
+
+// Evaluators run in long-lived helper processes ("checker hosts") instead
+// of inside the judger, so a checker that crashes, leaks or never returns
+// costs one subtest instead of the whole judging session. A host is this
+// judger's own binary started as `main_judger --checker-host`; it keeps
+// every evaluator it loaded and answers requests over a SOCK_SEQPACKET
+// socket on its stdin.
+//
+// A call that takes longer than the time limit, or a host that dies (the
+// memory limit is enforced on the host: its cgroup leaf, or RLIMIT_AS when
+// cgroups are unusable), kills the host and is retried once on a fresh
+// one; only a second failure in a row fails the call with CPError<IE>.
+// POSIX only: on Windows the pool stays disabled and evaluators are called
+// in-process.
+class CheckerPool {
+public:
+  static CheckerPool &instance();
+  ~CheckerPool(); // stops every host
+
+  // `hosts` helpers, started on first use; 0 disables the pool. Call before
+  // the first judge()
+  void configure(int hosts, float timeLimit, uint64_t memoryBytes);
+  bool enabled() const { return !hosts_.empty(); }
+
+  // call_evaluator() of the evaluator at `evaluator` (see JudgeAPI.h) on
+  // an idle host; blocks while all of them are busy. Throws CPError<IE>
+  // when the evaluator can't be loaded, or crashes or runs out of time or
+  // memory twice in a row
+  CheckerVerdict judge(const fs::path &evaluator,
+                       const CheckRequest &request);
+
+private:
+  struct Host {
+    int pid = -1; // -1: not running
+    int sock = -1;
+    std::unique_ptr<CgroupLeaf> cgroup;
+  };
+
+  // One round trip; false with `failure` set when the host had to be
+  // stopped
+  bool call(Host &host, const std::string &request, CheckerVerdict &verdict,
+            std::string &failure);
+  void start(Host &host);
+  int stop(Host &host); // wait status of the killed host
+
+  std::mutex mutex_;
+  std::condition_variable idle_cv_;
+  std::vector<std::unique_ptr<Host>> hosts_;
+  std::vector<Host *> idle_;
+  std::string exe_;
+  int timeLimitMs_ = 10000;
+  uint64_t memory_ = 0;
+};
+
+// Body of `main_judger --checker-host`: serves requests on `sock` until the
+// judger closes it
+int checker_host_main(int sock);
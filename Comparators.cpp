@@ -0,0 +1,246 @@
+#include "Comparators.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr std::string_view kBom = "\xEF\xBB\xBF";
+
+bool is_space(unsigned char c) { return std::isspace(c) != 0; }
+
+std::string_view skip_bom(std::string_view s) {
+  if (s.starts_with(kBom))
+    s.remove_prefix(kBom.size());
+  return s;
+}
+
+// Next whitespace-separated token of `s` at or after `pos`; empty at the end
+std::string_view next_token(std::string_view s, std::size_t &pos) {
+  while (pos < s.size() && is_space(s[pos]))
+    ++pos;
+  std::size_t begin = pos;
+  while (pos < s.size() && !is_space(s[pos]))
+    ++pos;
+  return s.substr(begin, pos - begin);
+}
+
+// Next line of `s` at `pos`, without its trailing whitespace
+std::string_view next_line(std::string_view s, std::size_t &pos) {
+  std::size_t end = std::min(s.find('\n', pos), s.size());
+  std::string_view line = s.substr(pos, end - pos);
+  pos = end + 1;
+  while (!line.empty() && is_space(line.back()))
+    line.remove_suffix(1);
+  return line;
+}
+
+bool same_token(std::string_view a, std::string_view b, bool ignoreCase) {
+  a = a.substr(0, TokenComparator::kMaxToken);
+  b = b.substr(0, TokenComparator::kMaxToken);
+  if (!ignoreCase)
+    return a == b;
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                    [](unsigned char x, unsigned char y) {
+                      return std::tolower(x) == std::tolower(y);
+                    });
+}
+
+bool tokens_match(std::string_view expected, std::string_view output) {
+  expected = skip_bom(expected);
+  output = skip_bom(output);
+  std::size_t i = 0, j = 0;
+  for (;;) {
+    std::string_view a = next_token(expected, i), b = next_token(output, j);
+    if (a.empty() || b.empty())
+      return a.empty() && b.empty();
+    if (!same_token(a, b, true))
+      return false;
+  }
+}
+
+bool lines_match(std::string_view expected, std::string_view output) {
+  std::size_t i = 0, j = 0;
+  // A side that ran out contributes empty lines
+  while (i < expected.size() || j < output.size()) {
+    std::string_view a = i < expected.size() ? next_line(expected, i) : "";
+    std::string_view b = j < output.size() ? next_line(output, j) : "";
+    std::size_t x = 0, y = 0;
+    for (;;) {
+      std::string_view ta = next_token(a, x), tb = next_token(b, y);
+      if (ta.empty() || tb.empty()) {
+        if (!ta.empty() || !tb.empty())
+          return false;
+        break;
+      }
+      if (ta != tb)
+        return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+TokenComparator::TokenComparator(const fs::path &expected, bool ignoreCase)
+    : ignoreCase_(ignoreCase) {
+  std::ifstream f(expected, std::ios::binary);
+  if (!f)
+    throw std::runtime_error("cannot open " + expected.string());
+  std::stringstream ss;
+  ss << f.rdbuf();
+  expected_ = ss.str();
+  if (std::string_view(expected_).starts_with(kBom))
+    pos_ = kBom.size();
+  if (ignoreCase_)
+    for (char &c : expected_)
+      c = (char)std::tolower((unsigned char)c);
+}
+
+bool TokenComparator::feed(std::string_view chunk) {
+  if (failed_)
+    return false;
+  if (!head_done_) {
+    // Hold the first bytes back until we know whether they are a BOM
+    std::size_t take = std::min(chunk.size(), kBom.size() - head_.size());
+    head_.append(chunk.substr(0, take));
+    chunk.remove_prefix(take);
+    if (head_.size() < kBom.size() && kBom.starts_with(head_))
+      return true;
+    head_done_ = true;
+    std::string_view head = head_;
+    if (head == kBom)
+      head = {};
+    for (unsigned char c : head)
+      if (!feed_byte(c))
+        return false;
+  }
+  for (unsigned char c : chunk)
+    if (!feed_byte(c))
+      return false;
+  return true;
+}
+
+bool TokenComparator::feed_byte(unsigned char c) {
+  if (is_space(c)) {
+    if (in_token_ && !end_token())
+      return false;
+    return true;
+  }
+  if (ignoreCase_)
+    c = (unsigned char)std::tolower(c);
+
+  if (!in_token_) {
+    // Start of a token: the expected side must have one here as well
+    while (pos_ < expected_.size() && is_space(expected_[pos_]))
+      ++pos_;
+    if (pos_ == expected_.size())
+      return !(failed_ = true);
+    in_token_ = true;
+    token_len_ = 0;
+  }
+  if (token_len_++ >= kMaxToken)
+    return true; // past the compared prefix
+  if (pos_ == expected_.size() || is_space(expected_[pos_]) ||
+      (unsigned char)expected_[pos_] != c)
+    return !(failed_ = true);
+  ++pos_;
+  return true;
+}
+
+bool TokenComparator::end_token() {
+  in_token_ = false;
+  if (token_len_ >= kMaxToken) {
+    while (pos_ < expected_.size() && !is_space(expected_[pos_]))
+      ++pos_;
+    return true;
+  }
+  // The expected token must end here too, not merely share a prefix
+  if (pos_ < expected_.size() && !is_space(expected_[pos_]))
+    return !(failed_ = true);
+  return true;
+}
+
+bool TokenComparator::finish() {
+  if (!head_done_) {
+    head_done_ = true;
+    std::string head = std::move(head_);
+    if (head != kBom)
+      for (unsigned char c : head)
+        if (!feed_byte(c))
+          return false;
+  }
+  if (failed_ || (in_token_ && !end_token()))
+    return false;
+  while (pos_ < expected_.size() && is_space(expected_[pos_]))
+    ++pos_;
+  return pos_ == expected_.size();
+}
+
+BuiltinChecker builtin_checker(const fs::path &evaluator) {
+  std::string name = evaluator.stem().string();
+  if (name.starts_with("lib"))
+    name.erase(0, 3);
+  if (name == "C1LinesWordsIgnoreCase")
+    return BuiltinChecker::Tokens;
+  if (name == "C2LinesWordsCase")
+    return BuiltinChecker::LinesWords;
+  if (name == "Exact")
+    return BuiltinChecker::Exact;
+  return BuiltinChecker::None;
+}
+
+bool builtin_check(BuiltinChecker checker, std::string_view expected,
+                   std::string_view output) {
+  switch (checker) {
+  case BuiltinChecker::Tokens:
+    return tokens_match(expected, output);
+  case BuiltinChecker::LinesWords:
+    return lines_match(expected, output);
+  case BuiltinChecker::Exact:
+    return expected == output;
+  case BuiltinChecker::None:
+    break;
+  }
+  throw std::logic_error("builtin_check() without a built-in checker");
+}
+
+MappedFile::MappedFile(const fs::path &path) {
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("cannot open " + path.string());
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      close(fd);
+      map_ = map;
+      view_ = std::string_view(static_cast<const char *>(map), st.st_size);
+      return;
+    }
+  }
+  close(fd);
+#endif
+  // Empty, not a regular file or not mappable
+  std::ifstream f(path, std::ios::binary);
+  if (!f)
+    throw std::runtime_error("cannot open " + path.string());
+  std::stringstream ss;
+  ss << f.rdbuf();
+  copy_ = ss.str();
+  view_ = copy_;
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (map_)
+    munmap(map_, view_.size());
+#endif
+}
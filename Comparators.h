@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+// A check fed the contestant's output incrementally while the program is
+// still running (RunOptions::comparator)
+class OutputComparator {
+public:
+  virtual ~OutputComparator() = default;
+  // Next chunk of output; false as soon as it can no longer match
+  virtual bool feed(std::string_view chunk) = 0;
+  // End of output; true when it matched
+  virtual bool finish() = 0;
+};
+
+// Whitespace-separated token comparison against an expected output. Same
+// verdicts as C1LinesWordsIgnoreCase (with ignoreCase) run after the fact:
+// ASCII case folding, a leading UTF-8 BOM skipped on either side, tokens
+// compared up to their first 4095 bytes.
+class TokenComparator : public OutputComparator {
+public:
+  // Throws std::runtime_error when `expected` can't be read
+  TokenComparator(const fs::path &expected, bool ignoreCase);
+
+  bool feed(std::string_view chunk) override;
+  // true when every expected token was matched
+  bool finish() override;
+
+  static constexpr std::size_t kMaxToken = 4095;
+
+private:
+  bool feed_byte(unsigned char c);
+  bool end_token();
+
+  std::string expected_;
+  std::size_t pos_ = 0; // next unmatched byte of expected_
+  bool ignoreCase_;
+  bool failed_ = false;
+  bool in_token_ = false;
+  std::size_t token_len_ = 0;
+  std::string head_; // first bytes of the output, until the BOM is decided
+  bool head_done_ = false;
+};
+
+// The stock evaluators, compiled in: an output is compared in memory with
+// no dlopen() and no Judge() call.
+//   Tokens     - C1LinesWordsIgnoreCase, same verdicts as TokenComparator
+//   LinesWords - C2LinesWordsCase: line by line, case-sensitive words,
+//                trailing whitespace ignored. Unlike the library, an output
+//                that stops early is rejected (trailing blank lines aside)
+//   Exact      - byte for byte
+enum class BuiltinChecker { None, Tokens, LinesWords, Exact };
+
+// The built-in standing in for the evaluator library `evaluator`, matched by
+// name ("Exact" has no library); None for custom evaluators
+BuiltinChecker builtin_checker(const fs::path &evaluator);
+bool builtin_check(BuiltinChecker checker, std::string_view expected,
+                   std::string_view output);
+
+// Read-only view of a whole file, mmap()ed where possible
+class MappedFile {
+public:
+  // Throws std::runtime_error when `path` can't be read
+  explicit MappedFile(const fs::path &path);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  std::string_view view() const { return view_; }
+
+private:
+  std::string_view view_;
+  void *map_ = nullptr; // null when read into copy_ instead
+  std::string copy_;
+};
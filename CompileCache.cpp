@@ -0,0 +1,259 @@
+#include "CompileCache.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <process.h>
+#include <windows.h>
+#else
+#include "Spawn.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+long process_id() {
+#ifdef _WIN32
+  return _getpid();
+#else
+  return getpid();
+#endif
+}
+
+// Variables that change what compilers and their drivers do without
+// showing up in the command
+constexpr const char *kCompilerEnv[] = {
+    "PATH", "CPATH", "C_INCLUDE_PATH", "CPLUS_INCLUDE_PATH", "LIBRARY_PATH",
+    "GCC_EXEC_PREFIX", "COMPILER_PATH", "LD_LIBRARY_PATH", "SOURCE_DATE_EPOCH",
+    "CLASSPATH", "JAVA_HOME", "JAVA_TOOL_OPTIONS", "_JAVA_OPTIONS",
+    "JDK_JAVA_OPTIONS", "PYTHONPATH", "INCLUDE", "LIB", "LIBPATH",
+};
+
+// false when `file` can't be read
+bool hash_file(Sha256 &hash, const fs::path &file) {
+  std::ifstream in(file, std::ios::binary);
+  if (!in)
+    return false;
+  char buf[65536];
+  while (in.read(buf, sizeof(buf)) || in.gcount() > 0)
+    hash.update(buf, (std::size_t)in.gcount());
+  return !in.bad();
+}
+
+// Where the compiler lives (and what that resolves to), how large it is and
+// when it changed: a compiler upgrade invalidates everything compiled by the
+// old one, including one that only retargets a symlink
+std::string compiler_identity(const std::string &program) {
+#ifdef _WIN32
+  std::wstring name = fs::path(program).wstring();
+  wchar_t found[MAX_PATH];
+  fs::path path = SearchPathW(nullptr, name.c_str(), L".exe", MAX_PATH, found,
+                              nullptr)
+                      ? fs::path(found)
+                      : fs::path(program);
+  std::error_code ec;
+  auto size = fs::file_size(path, ec);
+  auto mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+  return path.string() + '\n' + std::to_string(size) + '\n' +
+         std::to_string(mtime);
+#else
+  std::string path = resolve_executable(program);
+  std::error_code ec;
+  std::string target = fs::canonical(path, ec).string();
+  struct stat st {};
+  stat(path.c_str(), &st);
+  return path + '\n' + target + '\n' + std::to_string(st.st_size) + '\n' +
+         std::to_string(st.st_mtim.tv_sec) + '.' +
+         std::to_string(st.st_mtim.tv_nsec);
+#endif
+}
+
+// Bumped whenever what an entry holds changes, so old entries stop matching
+constexpr std::string_view kFormat = "2";
+
+// Where this submission lives, as named in cached compiler output. Another
+// submission hitting the entry sees its own paths, not the first one's
+using Locations = std::vector<std::pair<std::string, std::string>>;
+Locations locations(const fs::path &workdir, const fs::path &source) {
+  Locations found = {{"SOURCE", source.string()},
+                     {"SOURCEDIR", source.parent_path().string()},
+                     {"WORKDIR", workdir.string()}};
+  // The longest first: the source is inside its directory
+  std::sort(found.begin(), found.end(), [](const auto &a, const auto &b) {
+    return a.second.size() > b.second.size();
+  });
+  return found;
+}
+
+// Replaces the locations by %NAME% placeholders, a literal % by %%
+std::string abstract_paths(const std::string &text, const Locations &where) {
+  std::string out;
+  out.reserve(text.size());
+  for (std::size_t i = 0; i < text.size();) {
+    if (text[i] == '%') {
+      out += "%%";
+      ++i;
+      continue;
+    }
+    auto it = std::find_if(where.begin(), where.end(), [&](const auto &loc) {
+      return !loc.second.empty() && text.compare(i, loc.second.size(),
+                                                 loc.second) == 0;
+    });
+    if (it == where.end()) {
+      out += text[i++];
+      continue;
+    }
+    out += '%' + it->first + '%';
+    i += it->second.size();
+  }
+  return out;
+}
+
+std::string expand_paths(const std::string &text, const Locations &where) {
+  std::string out;
+  out.reserve(text.size());
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    std::size_t end;
+    if (text[i] != '%' || (end = text.find('%', i + 1)) == std::string::npos) {
+      out += text[i];
+      continue;
+    }
+    std::string_view name(text.data() + i + 1, end - i - 1);
+    auto it = std::find_if(where.begin(), where.end(),
+                           [&](const auto &loc) { return loc.first == name; });
+    if (name.empty())
+      out += '%';
+    else if (it != where.end())
+      out += it->second;
+    else
+      out.append(text, i, end - i + 1);
+    i = end;
+  }
+  return out;
+}
+
+// "result" of an entry: exit code and the sizes of stdout and stderr on one
+// line, then both outputs with paths abstracted
+void write_result(const fs::path &file, const ProcessResult &result) {
+  std::ofstream out(file, std::ios::binary);
+  out << result.exit_code << ' ' << result.stdout_data.size() << ' '
+      << result.stderr_data.size() << '\n'
+      << result.stdout_data << result.stderr_data;
+}
+
+bool read_result(const fs::path &file, ProcessResult &result) {
+  std::ifstream in(file, std::ios::binary);
+  std::size_t out_size, err_size;
+  if (!(in >> result.exit_code >> out_size >> err_size) || in.get() != '\n')
+    return false;
+  result.stdout_data.resize(out_size);
+  result.stderr_data.resize(err_size);
+  in.read(result.stdout_data.data(), (std::streamsize)out_size);
+  in.read(result.stderr_data.data(), (std::streamsize)err_size);
+  return (bool)in;
+}
+} // namespace
+
+CompileCache &CompileCache::instance() {
+  static CompileCache cache;
+  return cache;
+}
+
+void CompileCache::configure(fs::path root) {
+  root_ = std::move(root);
+  std::error_code ec;
+  if (!root_.empty())
+    fs::create_directories(root_, ec);
+}
+
+std::string CompileCache::key(const fs::path &source,
+                              const std::vector<std::string> &command,
+                              const fs::path &cwd) {
+  Sha256 hash;
+  if (command.empty() || !hash_file(hash, source))
+    return {};
+  // Every field is NUL-terminated so that neighbours can't run into each
+  // other
+  const std::string_view end("", 1);
+  hash.update(end);
+  hash.update(kFormat);
+  hash.update(end);
+  for (const auto &arg : command) {
+    hash.update(arg);
+    hash.update(end);
+    // Flags in a response file count as much as those on the command line
+    if (arg.size() > 1 && arg[0] == '@') {
+      hash_file(hash, cwd / fs::path(arg.substr(1)));
+      hash.update(end);
+    }
+  }
+  for (const char *name : kCompilerEnv) {
+    const char *value = std::getenv(name);
+    hash.update(name);
+    hash.update(value ? "=" + std::string(value) : std::string());
+    hash.update(end);
+  }
+  hash.update(compiler_identity(command[0]));
+  return hash.hex_digest();
+}
+
+bool CompileCache::lookup(const std::string &key, const fs::path &workdir,
+                          const fs::path &source, ProcessResult &result) {
+  if (!enabled() || key.empty())
+    return false;
+  fs::path entry = root_ / key;
+  ProcessResult cached{};
+  if (!read_result(entry / "result", cached))
+    return false;
+  std::error_code ec;
+  fs::copy(entry / "files", workdir,
+           fs::copy_options::recursive | fs::copy_options::overwrite_existing,
+           ec);
+  if (ec)
+    return false;
+  const Locations where = locations(workdir, source);
+  cached.stdout_data = expand_paths(cached.stdout_data, where);
+  cached.stderr_data = expand_paths(cached.stderr_data, where);
+  result = std::move(cached);
+  return true;
+}
+
+void CompileCache::store(const std::string &key, const fs::path &workdir,
+                         const fs::path &source, const ProcessResult &result) {
+  if (!enabled() || key.empty())
+    return;
+  std::error_code ec;
+  if (fs::exists(root_ / key, ec))
+    return;
+
+  // Built aside and renamed into place as a whole
+  fs::path tmp = root_ / (".tmp-" + std::to_string(process_id()) + "-" +
+                          std::to_string(counter_++));
+  fs::create_directories(tmp / "files", ec);
+  for (const auto &file : fs::directory_iterator(workdir, ec)) {
+    if (file.path().filename() == source.filename())
+      continue;
+    fs::copy(file.path(), tmp / "files" / file.path().filename(),
+             fs::copy_options::recursive, ec);
+    if (ec)
+      break;
+  }
+  if (!ec) {
+    const Locations where = locations(workdir, source);
+    ProcessResult abstracted = result;
+    abstracted.stdout_data = abstract_paths(result.stdout_data, where);
+    abstracted.stderr_data = abstract_paths(result.stderr_data, where);
+    write_result(tmp / "result", abstracted);
+  }
+  // Another judge may have published the same entry meanwhile
+  if (ec || (fs::rename(tmp, root_ / key, ec), ec))
+    fs::remove_all(tmp, ec);
+}
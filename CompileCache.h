@@ -0,0 +1,53 @@
+#pragma once
+#include "ProcessIO.h"
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Content-addressed store of compilation outcomes, so that unchanged
+// sources (re-saves, rejudges, copied templates) are not compiled again.
+// An entry is keyed by the SHA-256 of the source bytes, the compiler
+// command, the contents of its @response files, the environment variables
+// compilers read (include and library paths, CLASSPATH, ...) and the
+// compiler binary's path, symlink target, size and modification time; it
+// holds every file the compilation left in the working directory plus the
+// exit code and output, so compile errors are cached as well. The output is
+// stored with the source's path, its directory and the working directory
+// replaced by placeholders, and a hit gets its own paths back. Headers and
+// libraries the source pulls in are not part of the key, nor is anything a
+// wrapper script does: clear the cache after changing those.
+//
+// Entries are published with an atomic rename, which keeps concurrent
+// judges (--jobs) from ever seeing a half-written one. Nothing is evicted:
+// remove the directory to start over.
+class CompileCache {
+public:
+  static CompileCache &instance();
+
+  // Entries live below `root`; an empty root disables the cache. Call
+  // before the first lookup()
+  void configure(fs::path root);
+  bool enabled() const { return !root_.empty(); }
+
+  // `command` is the compiler's argv without anything that differs between
+  // otherwise identical compilations (the submission's own path), to be run
+  // in `cwd`. Empty when the source is unreadable
+  static std::string key(const fs::path &source,
+                         const std::vector<std::string> &command,
+                         const fs::path &cwd);
+
+  // On a hit, copies the cached files into `workdir` and fills `result`,
+  // naming `source` where the compiler named the one it was stored with
+  bool lookup(const std::string &key, const fs::path &workdir,
+              const fs::path &source, ProcessResult &result);
+  // Records what the compilation left in `workdir`, except `source`
+  void store(const std::string &key, const fs::path &workdir,
+             const fs::path &source, const ProcessResult &result);
+
+private:
+  fs::path root_;
+  std::atomic<unsigned> counter_{0}; // names of unpublished entries
+};
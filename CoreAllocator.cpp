@@ -0,0 +1,140 @@
+#include "CoreAllocator.h"
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef __linux__
+#include <fstream>
+#include <sched.h>
+
+namespace {
+// -1 when the file is missing (e.g. sysfs not mounted)
+int read_topology(int cpu, const char *name) {
+  std::ifstream f("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                  "/topology/" + name);
+  int value = -1;
+  f >> value;
+  return value;
+}
+
+// CPUs to hand out, lowest-numbered first
+std::vector<int> usable_cpus(CorePolicy policy) {
+  std::vector<int> cpus;
+  cpu_set_t allowed;
+  if (policy == CorePolicy::None ||
+      sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+    return cpus;
+
+  // Siblings share (package, core id); the first of them stands for the core
+  std::map<std::pair<int, int>, int> cores;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, &allowed))
+      continue;
+    if (policy == CorePolicy::Logical) {
+      cpus.push_back(cpu);
+      continue;
+    }
+    int core = read_topology(cpu, "core_id");
+    std::pair<int, int> key{read_topology(cpu, "physical_package_id"),
+                            core < 0 ? -1 - cpu : core};
+    cores.emplace(key, cpu);
+  }
+  for (const auto &[key, cpu] : cores)
+    cpus.push_back(cpu);
+  std::sort(cpus.begin(), cpus.end());
+  return cpus;
+}
+} // namespace
+#else
+namespace {
+std::vector<int> usable_cpus(CorePolicy) { return {}; }
+} // namespace
+#endif
+
+CorePolicy parse_core_policy(std::string_view name) {
+  std::string lower(name);
+  for (char &c : lower)
+    c = (char)std::tolower((unsigned char)c);
+  if (lower.empty() || lower == "none")
+    return CorePolicy::None;
+  if (lower == "physical")
+    return CorePolicy::Physical;
+  if (lower == "logical")
+    return CorePolicy::Logical;
+  throw std::invalid_argument("unknown core policy: " + std::string(name));
+}
+
+CoreAllocator::Lease &CoreAllocator::Lease::operator=(Lease &&other) noexcept {
+  if (this != &other) {
+    if (owner_)
+      owner_->release(cpu_);
+    owner_ = std::exchange(other.owner_, nullptr);
+    cpu_ = std::exchange(other.cpu_, -1);
+  }
+  return *this;
+}
+
+CoreAllocator::Lease::~Lease() {
+  if (owner_)
+    owner_->release(cpu_);
+}
+
+CoreAllocator &CoreAllocator::instance() {
+  static CoreAllocator allocator;
+  return allocator;
+}
+
+void CoreAllocator::configure(CorePolicy policy) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  free_ = usable_cpus(policy);
+  capacity_ = free_.size();
+  // Hand out from the back, lowest CPU first
+  std::reverse(free_.begin(), free_.end());
+}
+
+CoreAllocator::Lease CoreAllocator::acquire() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (capacity_ == 0)
+    return {};
+  released_.wait(lock, [&] { return !free_.empty(); });
+  int cpu = free_.back();
+  free_.pop_back();
+  return Lease(this, cpu);
+}
+
+void CoreAllocator::acquire_async(std::function<void(Lease)> granted) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (capacity_ == 0) {
+    lock.unlock();
+    granted({});
+    return;
+  }
+  if (free_.empty()) {
+    waiting_.push_back(std::move(granted));
+    return;
+  }
+  int cpu = free_.back();
+  free_.pop_back();
+  lock.unlock();
+  granted(Lease(this, cpu));
+}
+
+void CoreAllocator::release(int cpu) {
+  std::function<void(Lease)> next;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (waiting_.empty()) {
+      free_.push_back(cpu);
+    } else {
+      next = std::move(waiting_.front());
+      waiting_.pop_front();
+    }
+  }
+  if (next)
+    next(Lease(this, cpu));
+  else
+    released_.notify_one();
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// How runs that ask for an exclusive core (RunOptions::exclusiveCore) are
+// placed. Only the CPUs main_judger itself may use (sched_getaffinity, e.g.
+// under taskset or a cpuset) are handed out.
+enum class CorePolicy {
+  None,     // no pinning; runs go wherever the scheduler puts them
+  Physical, // one CPU per physical core, its SMT siblings are left idle
+  Logical,  // every logical CPU, SMT siblings included
+};
+
+// "none", "physical" or "logical", case-insensitive; throws
+// std::invalid_argument otherwise
+CorePolicy parse_core_policy(std::string_view name);
+
+// Process-wide pool of CPUs that concurrent runs are pinned to, one run per
+// CPU, so that a parallel judge times programs like a serial one would.
+// Pinning is Linux-only; elsewhere every lease is empty.
+class CoreAllocator {
+public:
+  // Owns one CPU until destroyed; cpu() is -1 for an empty lease
+  class Lease {
+  public:
+    Lease() = default;
+    Lease(Lease &&other) noexcept : owner_(other.owner_), cpu_(other.cpu_) {
+      other.owner_ = nullptr;
+      other.cpu_ = -1;
+    }
+    Lease &operator=(Lease &&other) noexcept;
+    ~Lease();
+    int cpu() const { return cpu_; }
+
+  private:
+    friend class CoreAllocator;
+    Lease(CoreAllocator *owner, int cpu) : owner_(owner), cpu_(cpu) {}
+    CoreAllocator *owner_ = nullptr;
+    int cpu_ = -1;
+  };
+
+  static CoreAllocator &instance();
+
+  // Reads the CPU topology and rebuilds the pool; call before any lease is
+  // taken
+  void configure(CorePolicy policy);
+  // Blocks until a CPU is free; an empty lease under CorePolicy::None
+  Lease acquire();
+  // Non-blocking variant: `granted` gets the lease right away when a CPU is
+  // free, otherwise later on the thread whose lease is released. Queued
+  // callers are served before blocked acquire() ones.
+  void acquire_async(std::function<void(Lease)> granted);
+  // Number of runs that can be pinned at the same time, 0 when not pinning
+  std::size_t capacity() const { return capacity_; }
+
+private:
+  void release(int cpu);
+
+  std::mutex mutex_;
+  std::condition_variable released_;
+  std::vector<int> free_;
+  std::deque<std::function<void(Lease)>> waiting_;
+  std::size_t capacity_ = 0;
+};
@@ -1,6 +1,10 @@
 #include "JudgeAPI.h"
+#include "Comparators.h"
+#include <atomic>
 #include <cstring>
 #include <filesystem>
+#include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #ifdef _WIN32
@@ -75,7 +79,10 @@ std::string describe_last_error() {
   return result + " (code " + std::to_string(code) + ")";
 }
 #endif
-void Load(const char *path) {
+// What JudgeAPIFuncUTF8() forwards to
+static std::atomic<JudgeFn> last_judge{nullptr};
+
+Evaluator Load(const char *path) {
   if (!path)
     throw std::runtime_error("Load(): null path");
 
@@ -114,13 +121,19 @@ void Load(const char *path) {
     throw std::runtime_error("LoadLibraryW failed: " + result);
   }
 
-  auto fn = reinterpret_cast<JudgeFn>(GetProcAddress(mod, "Judge"));
+  Evaluator evaluator;
+  evaluator.judge = reinterpret_cast<JudgeFn>(GetProcAddress(mod, "Judge"));
+  evaluator.judgeV2 =
+      reinterpret_cast<JudgeV2Fn>(GetProcAddress(mod, "JudgeV2"));
+  evaluator.judgeBatch =
+      reinterpret_cast<JudgeBatchV2Fn>(GetProcAddress(mod, "JudgeBatchV2"));
 
-  if (!fn)
+  if (!evaluator.judge && !evaluator.judgeV2 && !evaluator.judgeBatch)
     throw std::runtime_error("GetProcAddress(Judge) failed: " +
                              describe_last_error());
-
-  _judge = fn;
+  if (evaluator.judge)
+    last_judge.store(evaluator.judge);
+  return evaluator;
 
 #else
   void *mod = dlopen(path, RTLD_NOW | RTLD_LOCAL);
@@ -128,19 +141,55 @@ void Load(const char *path) {
     throw std::runtime_error(std::string(dlerror()) + ": " +
                              describe_last_error());
 
-  auto fn = reinterpret_cast<JudgeFn>(dlsym(mod, "Judge"));
+  Evaluator evaluator;
+  evaluator.judgeV2 = reinterpret_cast<JudgeV2Fn>(dlsym(mod, "JudgeV2"));
+  evaluator.judgeBatch =
+      reinterpret_cast<JudgeBatchV2Fn>(dlsym(mod, "JudgeBatchV2"));
+  evaluator.judge = reinterpret_cast<JudgeFn>(dlsym(mod, "Judge"));
 
-  if (!fn)
+  if (!evaluator.judge && !evaluator.judgeV2 && !evaluator.judgeBatch)
     throw std::runtime_error(std::string(dlerror()) + ": " +
                              describe_last_error());
-
-  _judge = fn;
+  if (evaluator.judge)
+    last_judge.store(evaluator.judge);
+  return evaluator;
 
 #endif
 }
-double STDCALL JudgeAPIFuncUTF8(char *contestantsDir, char *testsDir,
-                                char *testOutputs, char *testName,
-                                char **comments) {
+EvaluatorRegistry &EvaluatorRegistry::instance() {
+  static EvaluatorRegistry registry;
+  return registry;
+}
+
+Evaluator EvaluatorRegistry::get(const std::filesystem::path &path) {
+  std::string key =
+      std::filesystem::absolute(path).lexically_normal().string();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (auto it = loaded_.find(key); it != loaded_.end())
+    return it->second;
+  if (auto it = failed_.find(key); it != failed_.end())
+    throw std::runtime_error(it->second);
+  try {
+    Evaluator evaluator =
+        Load(std::filesystem::canonical(path).string().c_str());
+    loaded_.emplace(key, evaluator);
+    return evaluator;
+  } catch (const std::exception &e) {
+    failed_.emplace(key, e.what());
+    throw std::runtime_error(e.what());
+  }
+}
+
+std::size_t EvaluatorRegistry::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return loaded_.size();
+}
+
+namespace {
+// Calls `judge` with UTF-8 arguments, converting to and from UTF-16 on
+// Windows
+double judge_utf8(JudgeFn judge, char *contestantsDir, char *testsDir,
+                  char *testOutputs, char *testName, char **comments) {
 
 #if defined(_WIN32)
 
@@ -153,16 +202,121 @@ double STDCALL JudgeAPIFuncUTF8(char *contestantsDir, char *testsDir,
   wchar_t *wComments = nullptr;
 
   double result =
-      _judge(wCTestsDir.empty() ? nullptr : wCTestsDir.data(),
-             wTestsDir.empty() ? nullptr : wTestsDir.data(),
-             wTestOutputs.empty() ? nullptr : wTestOutputs.data(),
-             wTestName.empty() ? nullptr : wTestName.data(), &wComments);
+      judge(wCTestsDir.empty() ? nullptr : wCTestsDir.data(),
+            wTestsDir.empty() ? nullptr : wTestsDir.data(),
+            wTestOutputs.empty() ? nullptr : wTestOutputs.data(),
+            wTestName.empty() ? nullptr : wTestName.data(), &wComments);
 
   // Convert output comment back to UTF-8
   if (comments)
     *comments = wide_to_utf8_alloc(wComments);
   return result;
 #else
-  return _judge(contestantsDir, testsDir, testOutputs, testName, comments);
+  return judge(contestantsDir, testsDir, testOutputs, testName, comments);
 #endif
 }
+} // namespace
+
+extern "C" double STDCALL JudgeAPIFuncUTF8(char *contestantsDir,
+                                           char *testsDir, char *testOutputs,
+                                           char *testName, char **comments) {
+  JudgeFn judge = last_judge.load();
+  if (comments)
+    *comments = nullptr;
+  if (!judge)
+    return 0.0;
+  return judge_utf8(judge, contestantsDir, testsDir, testOutputs, testName,
+                    comments);
+}
+
+namespace {
+void append_comment(void *context, const char *text, size_t size) {
+  if (text)
+    static_cast<std::string *>(context)->append(text, size);
+}
+
+JudgeSpan span_of(const std::optional<MappedFile> &file) {
+  if (!file)
+    return {nullptr, 0};
+  return {file->view().data(), file->view().size()};
+}
+
+void map_if_present(std::optional<MappedFile> &file,
+                    const std::filesystem::path &path) {
+  if (!path.empty() && std::filesystem::is_regular_file(path))
+    file.emplace(path);
+}
+
+// A CheckRequest as JudgeV2() sees it; the spans point into the mappings
+struct MappedRequest {
+  std::optional<MappedFile> input, expected, output;
+  JudgeRequestV2 v2{};
+
+  MappedRequest(const CheckRequest &request, std::string &comments) {
+    map_if_present(input, request.input);
+    map_if_present(expected, request.expected);
+    map_if_present(output, request.output);
+    v2.version = JUDGE_ABI_VERSION;
+    v2.size = sizeof(v2);
+    v2.input = span_of(input);
+    v2.expected = span_of(expected);
+    v2.output = span_of(output);
+    v2.testName = request.testName.c_str();
+    v2.timeLimit = request.timeLimit;
+    v2.memoryLimit = request.memoryLimit;
+    v2.timeUsed = request.timeUsed;
+    v2.memoryUsed = request.memoryUsed;
+    v2.comment = append_comment;
+    v2.context = &comments;
+  }
+};
+} // namespace
+
+double call_evaluator(const Evaluator &evaluator, const CheckRequest &request,
+                      std::string &comments) {
+  if (!evaluator.judge && !evaluator.judgeV2) {
+    // Only JudgeBatchV2(): a batch of one
+    std::vector<std::string> batchComments;
+    double points =
+        call_evaluator_batch(evaluator, {request}, batchComments)[0];
+    comments += batchComments[0];
+    return points;
+  }
+  if (evaluator.judgeV2 &&
+      (request.testOutputs.find('|') == std::string::npos ||
+       !evaluator.judge)) {
+    MappedRequest mapped(request, comments);
+    return evaluator.judgeV2(&mapped.v2);
+  }
+
+  // Judge() takes mutable strings
+  std::string contestantsDir = request.contestantsDir,
+              testsDir = request.testsDir,
+              testOutputs = request.testOutputs, testName = request.testName;
+  char *text = nullptr;
+  double points =
+      judge_utf8(evaluator.judge, contestantsDir.data(), testsDir.data(),
+                 testOutputs.data(), testName.data(), &text);
+  if (text) {
+    comments += text;
+    free(text);
+  }
+  return points;
+}
+
+std::vector<double>
+call_evaluator_batch(const Evaluator &evaluator,
+                     const std::vector<CheckRequest> &requests,
+                     std::vector<std::string> &comments) {
+  comments.assign(requests.size(), {});
+  // Mappings stay put while the requests point into them
+  std::vector<std::unique_ptr<MappedRequest>> mapped;
+  std::vector<JudgeRequestV2> v2;
+  for (std::size_t i = 0; i < requests.size(); ++i) {
+    mapped.push_back(std::make_unique<MappedRequest>(requests[i], comments[i]));
+    v2.push_back(mapped.back()->v2);
+  }
+  std::vector<double> scores(requests.size(), 0.0);
+  evaluator.judgeBatch(v2.data(), v2.size(), scores.data());
+  return scores;
+}
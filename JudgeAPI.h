@@ -1,4 +1,12 @@
 #pragma once
+#include "JudgeV2.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #if defined(_WIN32) && !defined(_WIN64)
 #define STDCALL __stdcall
 #else
@@ -14,19 +22,68 @@ extern "C" double STDCALL JudgeAPIFunc(
     wchar_t *testName,    // __In__
     wchar_t **comments    // __Out__, __Freed_by_callee__
 );
-// always UTF-8
+// always UTF-8; the v1 entry point as before, now forwarding to the Judge()
+// of the evaluator Load() resolved last. The judger itself goes through
+// call_evaluator(), which knows which evaluator it means.
 extern "C" double STDCALL JudgeAPIFuncUTF8(
     char *contestantsDir,
     char *testsDir,    // __In__
     char *testOutputs, // __In__
     char *testName,    // __In__
     char **comments    // __Out__, __Freed_by_callee__
-); // will be a port to the non-utf8 version on windows or a stub for _judge
+);
 using JudgeFn =
 #ifdef _WIN32
     decltype(&JudgeAPIFunc);
 #else
     decltype(&JudgeAPIFuncUTF8);
 #endif
-inline JudgeFn _judge = nullptr;
-void Load(const char *path);
\ No newline at end of file
+// An evaluator library's entry points; at least one is set
+struct Evaluator {
+  JudgeFn judge = nullptr;    // legacy Judge()
+  JudgeV2Fn judgeV2 = nullptr; // JudgeV2(), see JudgeV2.h
+  JudgeBatchV2Fn judgeBatch = nullptr; // JudgeBatchV2()
+};
+
+// Opens the evaluator library and resolves its entry points; throws
+// std::runtime_error. Prefer EvaluatorRegistry, which does it only once.
+Evaluator Load(const char *path);
+
+// One subtest to check, with what either ABI needs
+struct CheckRequest {
+  // Judge(): directories and the '|'-separated output file names
+  std::string contestantsDir, testsDir, testOutputs, testName;
+  // JudgeV2(): files mapped for the checker; a missing output is empty
+  std::filesystem::path input, expected, output;
+  double timeLimit = 0, memoryLimit = 0, timeUsed = 0;
+  uint64_t memoryUsed = 0; // KiB
+};
+
+// Calls JudgeV2() when the evaluator has it and the test has a single
+// output file, Judge() otherwise (JudgeBatchV2() when that is all it has)
+double call_evaluator(const Evaluator &evaluator, const CheckRequest &request,
+                      std::string &comments);
+// One JudgeBatchV2() call for all of `requests`; the scores in order, and
+// comments[i] for requests[i]
+std::vector<double>
+call_evaluator_batch(const Evaluator &evaluator,
+                     const std::vector<CheckRequest> &requests,
+                     std::vector<std::string> &comments);
+
+// Every evaluator the judger uses, each loaded once for the whole process
+// and never unloaded. Safe to use from any thread.
+class EvaluatorRegistry {
+public:
+  static EvaluatorRegistry &instance();
+
+  // The evaluator at `path`, loaded on first use. Throws std::runtime_error
+  // when it can't be loaded; the failure is remembered, not retried.
+  Evaluator get(const std::filesystem::path &path);
+  // Evaluators loaded so far
+  std::size_t size();
+
+private:
+  std::mutex mutex_;
+  std::unordered_map<std::string, Evaluator> loaded_;
+  std::unordered_map<std::string, std::string> failed_;
+};
\ No newline at end of file
@@ -1,13 +1,20 @@
 #include "JudgeBackend.h"
+#include "CheckerHost.h"
+#include "Comparators.h"
+#include "CompileCache.h"
 #include "JudgeAPI.h"
 #include "ProcessIO.h"
+#include "Sandbox.h"
+#include "TokenIndex.h"
+#include "WorkdirPool.h"
 #include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <plog/Log.h>
-#include <random>
 #ifdef _WIN32
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
@@ -16,26 +23,6 @@
 using namespace std;
 namespace fs = std::filesystem;
 
-// Function to generate a random string of a specified length
-string random_string(size_t length) {
-  const string characters = "0123456789"
-                            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-                            "abcdefghijklmnopqrstuvwxyz";
-
-  random_device random_device;
-  mt19937 generator(random_device());
-
-  uniform_int_distribution<size_t> distribution(0, characters.length() - 1);
-
-  string random_string;
-  random_string.reserve(length);
-
-  for (size_t i = 0; i < length; ++i) {
-    random_string += characters[distribution(generator)];
-  }
-
-  return random_string;
-}
 
 vector<string> split_args_quoted(const string &s) {
   vector<string> out;
@@ -135,6 +122,18 @@ bool parse_compiler_cmd(const std::string &cmd, std::string &rawCmd,
   return true;
 }
 
+std::vector<std::string> split_output_files(const std::string &list) {
+  std::vector<std::string> names;
+  std::size_t begin = 0;
+  while (begin <= list.size()) {
+    std::size_t end = std::min(list.find('|', begin), list.size());
+    if (end > begin)
+      names.push_back(list.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  return names;
+}
+
 std::string load_file_to_string(const fs::path &filename) {
   std::ifstream file(fs::canonical(filename).string(), std::ios::binary);
 
@@ -147,45 +146,71 @@ std::string load_file_to_string(const fs::path &filename) {
   return content;
 }
 
-int idx = 0;
+std::atomic<int> idx{0};
+std::mutex scores_mutex;
 std::map<std::pair<string, string>, std::pair<std::string, double>> scores;
 
-void judge(fs::path subdir, fs::path tdir, string problem, string user,
-           const Configuration &conf,
-           const unordered_map<string, Testcases> &testcases,
-           fs::path &judger_path) {
-  string fn = std::to_string(++idx) + "[" + user + "][" + problem + "].txt";
-  fs::create_directory(subdir / "$History");
-  ofstream out(subdir / "$History" / fn);
-  if (!out.is_open()) {
-    PLOGE << subdir / "$History" / fn << " (" << strerror(errno) << ")";
-    return;
-  }
+void set_score(const string &user, const string &problem, string status,
+               double points) {
+  std::lock_guard<std::mutex> lock(scores_mutex);
+  scores[std::make_pair(user, problem)] = std::make_pair(status, points);
+}
+
+int next_judge_index() { return ++idx; }
+
+// $History report of the submission (`out`) and the log at once.
 // WARNING: NotImplemented multi input/output files
 #define _LOG(sev, msg)                                                         \
   {                                                                            \
     PLOG(sev) << msg;                                                          \
     out << msg << '\n';                                                        \
   }
+
+struct CompiledSubmission {
+  fs::path subdir, tdir;
+  string problem, user;
+  const Configuration *conf;
+  const Testcases *tests;
+  CompilerItem compiler;
+  string ext;
+  ofstream out; // $History report
+  std::optional<WorkdirPool::Lease> workdirLease;
+  fs::path workdir, exe;
+};
+
+shared_ptr<CompiledSubmission>
+compile_submission(fs::path subdir, fs::path tdir, string problem,
+                   string user, const Configuration &conf,
+                   const unordered_map<string, Testcases> &testcases,
+                   int index) {
+  auto submission = std::make_shared<CompiledSubmission>();
+  string fn = std::to_string(index) + "[" + user + "][" + problem + "].txt";
+  fs::create_directory(subdir / "$History");
+  ofstream &out = submission->out;
+  out.open(subdir / "$History" / fn);
+  if (!out.is_open()) {
+    PLOGE << subdir / "$History" / fn << " (" << strerror(errno) << ")";
+    return nullptr;
+  }
   auto it = testcases.find(problem);
   if (it == testcases.end()) {
     PLOGE << problem << " doesn't have tests!";
-    return;
+    return nullptr;
   }
   const Testcases &tests = it->second;
 
   fs::path sourceDir = subdir / user;
   if (!fs::is_directory(sourceDir)) {
     PLOGE << sourceDir << " is not a directory";
-    return;
+    return nullptr;
   }
 
   auto sourceFile = find_source_file(sourceDir, problem, conf.compiler.items);
   if (!sourceFile) {
     _LOG(plog::info,
          "[" << user << "/" << problem << "] source file not found");
-    scores[std::make_pair(user, problem)] = std::make_pair("-", 0.0);
-    return;
+    set_score(user, problem, "-", 0.0);
+    return nullptr;
   }
 
   string ext = sourceFile->extension().string();
@@ -197,20 +222,20 @@ void judge(fs::path subdir, fs::path tdir, string problem, string user,
   if (!compiler) {
     _LOG(plog::error,
          "[" << user << "/" << problem << "] no compiler for " << ext);
-    return;
+    return nullptr;
   }
 
   string rawCmd, rawWorkDir;
   if (!parse_compiler_cmd(compiler->cmd, rawCmd, rawWorkDir)) {
     PLOGE << "[" << user << "/" << problem << "] malformed compiler command ("
           << compiler->cmd << ')';
-    return;
+    return nullptr;
   }
 
+  // Wiped and handed to the next submission once this one is done
+  submission->workdirLease.emplace(WorkdirPool::instance().acquire());
   fs::path workdir = expand_percent_vars(
-      rawWorkDir, {{"PATH", (fs::path(conf.environment.contestHouse) /
-                             "judgeWORK" / random_string(16))
-                                .string()}});
+      rawWorkDir, {{"PATH", submission->workdirLease->path().string()}});
 
   fs::create_directories(workdir);
   fs::copy_file(*sourceFile, workdir / sourceFile->filename(),
@@ -222,16 +247,35 @@ void judge(fs::path subdir, fs::path tdir, string problem, string user,
   PLOGD << "[" << user << "/" << problem << "] compiling with: [" << expandedCmd
         << "] at [" << workdir << "]";
 
-  // Compile the code
+  // Compile the code, unless this source was compiled the same way before.
+  // The key leaves %PATH% unexpanded: it is the submission's own location.
+  CompileCache &cache = CompileCache::instance();
+  const string cacheKey =
+      cache.enabled()
+          ? CompileCache::key(*sourceFile,
+                              split_args_quoted(expand_percent_vars(
+                                  rawCmd, {{"NAME", name}, {"EXT", ext}})),
+                              workdir)
+          : string();
   ProcessResult compileInfo;
-  compileInfo =
-      run_command(split_args_quoted(expandedCmd), workdir, "", 600000.0);
+  if (cache.lookup(cacheKey, workdir, *sourceFile, compileInfo)) {
+    PLOGD << "[" << user << "/" << problem << "] compile cache hit "
+          << cacheKey;
+  } else {
+    RunOptions compile;
+    compile.time = 600000.0;
+    compile.maxMemory = 0; // compilers are trusted, only contestants capped
+    compile.maxProcesses = conf.environment.compileMaxProcesses;
+    compileInfo =
+        run_command(split_args_quoted(expandedCmd), workdir, compile);
+    cache.store(cacheKey, workdir, *sourceFile, compileInfo);
+  }
   if (compileInfo.exit_code != 0) {
     _LOG(plog::error, "[" << user << "/" << problem << "] Compiling failed");
     _LOG(plog::error, "stderr:\n" << compileInfo.stderr_data);
     _LOG(plog::error, "stdout:\n" << compileInfo.stdout_data);
-    scores[std::make_pair(user, problem)] = std::make_pair("X", 0.0);
-    return;
+    set_score(user, problem, "X", 0.0);
+    return nullptr;
   }
 
   // Find the compiled executable
@@ -239,81 +283,276 @@ void judge(fs::path subdir, fs::path tdir, string problem, string user,
   if (!exe) {
     _LOG(plog::error,
          "[" << user << "/" << problem << "] executable not found");
-    return;
+    return nullptr;
   }
 
   _LOG(plog::info,
        "[" << user << "/" << problem << "] compiled successfully at " << *exe);
 
-  // Load evaluator
-  Load(fs::canonical(judger_path / tests.EvaluatorName).string().c_str());
-  PLOGI << "[" << user << "/" << problem << "] loaded evaluator successfully";
+  submission->subdir = std::move(subdir);
+  submission->tdir = std::move(tdir);
+  submission->problem = std::move(problem);
+  submission->user = std::move(user);
+  submission->conf = &conf;
+  submission->tests = &tests;
+  submission->compiler = *compiler;
+  submission->ext = std::move(ext);
+  submission->workdir = std::move(workdir);
+  submission->exe = std::move(*exe);
+  return submission;
+}
 
-  double points = 0.0;
-  for (auto &tc : tests.subtests) {
+void test_submission(CompiledSubmission &submission, fs::path &judger_path) {
+  string &user = submission.user, &problem = submission.problem;
+  const string &ext = submission.ext;
+  const fs::path &tdir = submission.tdir, &workdir = submission.workdir;
+  const Configuration &conf = *submission.conf;
+  const Testcases &tests = *submission.tests;
+  const CompilerItem &compiler = submission.compiler;
+  ofstream &out = submission.out;
+
+  // Loaded once per process (normally at startup); throws if it can't be.
+  // Stock evaluators are built in, and with checker hosts the evaluator is
+  // only ever called in them
+  const fs::path evaluatorPath = judger_path / tests.EvaluatorName;
+  const BuiltinChecker builtin = builtin_checker(tests.EvaluatorName);
+  CheckerPool &checkers = CheckerPool::instance();
+  Evaluator evaluator = builtin != BuiltinChecker::None || checkers.enabled()
+                            ? Evaluator{}
+                            : EvaluatorRegistry::instance().get(evaluatorPath);
+
+  // C1LinesWordsIgnoreCase only compares tokens, which TokenComparator can
+  // do while the program is still writing
+  const bool streamed = tests.UseStdOut && builtin == BuiltinChecker::Tokens &&
+                        tests.OutputFile.find('|') == std::string::npos;
+  // The answer's digest sidecar, when prepared at startup, stands in for it
+  auto load_index = [&](const fs::path &expected) {
+    return TokenIndex::load(expected, builtin);
+  };
+  // JudgeBatchV2() checks every subtest in one call after the last run;
+  // the outputs are kept aside meanwhile, as the slots' workdirs are reset
+  const bool batched = evaluator.judgeBatch &&
+                       tests.OutputFile.find('|') == std::string::npos;
+  struct Pending {
+    const Subtest *tc;
+    CheckRequest check;
+  };
+  std::vector<Pending> pending;
+  std::optional<WorkdirPool::Lease> kept;
+  if (batched)
+    kept.emplace(WorkdirPool::instance().acquire());
+  const fs::path exeName =
+      fs::relative(fs::canonical(submission.exe), fs::canonical(workdir));
+
+  // Up to ParallelSubtests subtests are in flight at once, each in its own
+  // copy of the post-compile workdir and on its own core (the runs are
+  // driven by run_command_async()). Verdicts are still taken, logged and
+  // summed in subtest order, and a slot starts its next subtest only after
+  // its last one was checked.
+  struct Slot {
+    std::optional<WorkdirPool::Lease> lease; // empty: the compile workdir
+    fs::path dir;
+    std::unique_ptr<Sandbox> sandbox; // each subtest starts from a reset
+    const Subtest *tc = nullptr;
+    RunOptions run;
+    std::unique_ptr<OutputComparator> comparator;
+    std::future<ProcessResult> result;
+    std::exception_ptr error; // setting the run up failed
+    ~Slot() {
+      // The run still uses `run` and `comparator`
+      if (result.valid())
+        result.wait();
+    }
+  };
+  const auto &subtests = tests.subtests;
+  const std::size_t width = std::max<std::size_t>(
+      1, std::min<std::size_t>(
+             std::max(conf.environment.parallelSubtests, 1), subtests.size()));
+  std::vector<std::unique_ptr<Slot>> slots;
+  for (std::size_t i = 0; i < width; ++i) {
+    auto slot = std::make_unique<Slot>();
+    if (i == 0) {
+      slot->dir = workdir;
+    } else {
+      slot->lease.emplace(WorkdirPool::instance().acquire());
+      slot->dir = slot->lease->path();
+      fs::copy(workdir, slot->dir,
+               fs::copy_options::recursive |
+                   fs::copy_options::overwrite_existing);
+    }
+    slot->sandbox = std::make_unique<Sandbox>(slot->dir);
+    slots.push_back(std::move(slot));
+  }
+
+  auto launch = [&](Slot &slot, const Subtest &tc) {
+    slot.tc = &tc;
+    slot.comparator.reset();
+    slot.error = nullptr;
     float timeLimit = tc.TimeLimit == -1 ? tests.TimeLimit : tc.TimeLimit;
     float memoryLimit =
         tc.MemoryLimit == -1 ? tests.MemoryLimit : tc.MemoryLimit;
 
-    fs::remove(workdir / tests.InputFile);
-    fs::remove(workdir / tests.OutputFile);
-
     PLOGI << "[" << user << "/" << problem << "/" << tc.Name << "] judging...";
 
     try {
-      if (tests.UseStdIn) {
-        std::string input =
-            load_file_to_string(tdir / problem / tc.Name / tests.InputFile);
-        ProcessResult result =
-            run_command({fs::canonical(*exe).string()}, workdir, input,
-                        timeLimit, memoryLimit);
-        if (result.exit_code != 0)
-          throw CPError<CPErrors::IR>(result.exit_code);
-        if (result.time > timeLimit)
-          throw CPError<CPErrors::TLE>();
-
-        _LOG(plog::info, "Time ~" << result.time << " seconds");
-
-        if (tests.UseStdOut) {
-          ofstream output(tdir / problem / tc.Name / tests.OutputFile);
-          output << result.stdout_data;
+      // Test files are attached to the child's stdin/stdout directly, so
+      // neither the input nor the output is buffered in the judger
+      RunOptions &run = slot.run;
+      run = RunOptions{};
+      run.time = timeLimit;
+      run.maxMemory = memoryLimit;
+      run.maxProcesses = conf.environment.maxProcesses;
+      run.exclusiveCore = true;
+      run.idleTimeout = conf.environment.idleLimit;
+      // Before reset(): the leaf's memory.max depends on it
+      if (tests.UseStdOut && !streamed)
+        run.stdout_file = slot.dir / tests.OutputFile;
+      slot.sandbox->reset(run);
+      if (conf.environment.activeSecurity)
+        run.seccomp = compiler.security.empty()
+                          ? default_seccomp_profile(ext)
+                          : parse_seccomp_profile(compiler.security);
+      if (conf.environment.countInstructions)
+        run.instructionLimit = (uint64_t)(
+            timeLimit * conf.environment.instructionsPerSecond);
+      if (tests.UseStdIn)
+        run.stdin_file = tdir / problem / tc.Name / tests.InputFile;
+      else
+        fs::copy_file(tdir / problem / tc.Name / tests.InputFile,
+                      slot.dir / tests.InputFile);
+      if (streamed) {
+        fs::path expected = tdir / problem / tc.Name / tests.OutputFile;
+        if (auto index = load_index(expected))
+          slot.comparator =
+              std::make_unique<DigestComparator>(std::move(*index));
+        else
+          slot.comparator = std::make_unique<TokenComparator>(expected, true);
+        run.comparator = slot.comparator.get();
+      } else if (!tests.UseStdOut && !tests.UseStdIn)
+        for (const std::string &name : split_output_files(tests.OutputFile))
+          fs::copy_file(tdir / problem / tc.Name / name, slot.dir / name);
+
+      slot.result = run_command_future(
+          {fs::canonical(slot.dir / exeName).string()}, slot.dir, run);
+    } catch (...) {
+      slot.error = std::current_exception();
+    }
+  };
+
+  // Waits for the slot's run and scores it
+  auto conclude = [&](Slot &slot) -> double {
+    const Subtest &tc = *slot.tc;
+    const RunOptions &run = slot.run;
+    float timeLimit = tc.TimeLimit == -1 ? tests.TimeLimit : tc.TimeLimit;
+    try {
+      if (slot.error)
+        std::rethrow_exception(slot.error);
+      ProcessResult result = slot.result.get();
+
+      // Recorded before the verdict so that crashed runs are covered too
+      _LOG(plog::info, "Time ~" << result.time << " seconds, memory ~"
+                                << result.memory << " KiB");
+      _LOG(plog::info, "Wall " << result.wall << "s, user "
+                               << result.user_time << "s, sys "
+                               << result.sys_time << "s, page faults "
+                               << result.minor_faults << " minor/"
+                               << result.major_faults << " major, switches "
+                               << result.voluntary_switches << " voluntary/"
+                               << result.involuntary_switches
+                               << " involuntary, I/O " << result.bytes_read
+                               << " read/" << result.bytes_written
+                               << " written bytes, signal " << result.signal);
+      if (run.instructionLimit)
+        _LOG(plog::info, "Instructions " << result.instructions << " of "
+                                         << run.instructionLimit << ", cycles "
+                                         << result.cycles);
+      if (result.exit_code != 0)
+        throw CPError<CPErrors::IR>(result.exit_code);
+      if (!run.instructionLimit && result.time > timeLimit)
+        throw CPError<CPErrors::TLE>();
+
+      std::string comments;
+      double _points;
+      if (slot.comparator || builtin != BuiltinChecker::None) {
+        // Either checked as it was produced, or both sides compared in
+        // memory; a missing output file gets no points. As with the
+        // evaluator libraries, "a|b|c" earns a point per matching file.
+        auto check_file = [&](const std::string &name) {
+          if (!fs::is_regular_file(slot.dir / name))
+            return false;
+          fs::path expectedPath = tdir / problem / tc.Name / name;
+          MappedFile output(slot.dir / name);
+          if (auto index = load_index(expectedPath)) {
+            DigestComparator digest(std::move(*index));
+            return digest.feed(output.view()) && digest.finish();
+          }
+          MappedFile expected(expectedPath);
+          return builtin_check(builtin, expected.view(), output.view());
+        };
+        std::vector<bool> accepted;
+        if (slot.comparator)
+          accepted.push_back(slot.comparator->finish());
+        else
+          for (const std::string &name : split_output_files(tests.OutputFile))
+            accepted.push_back(check_file(name));
+        _points = 0.0;
+        for (bool ok : accepted) {
+          comments += ok ? "Kết quả khớp đáp án!\n" : "Kết quả KHÁC đáp án!\n";
+          _points += ok ? 1.0 : 0.0;
         }
       } else {
-        fs::copy_file(tdir / problem / tc.Name / tests.InputFile,
-                      workdir / tests.InputFile);
-        if (!tests.UseStdOut)
-          fs::copy_file(tdir / problem / tc.Name / tests.OutputFile,
-                        workdir / tests.OutputFile);
-
-        ProcessResult result = run_command({fs::canonical(*exe).string()},
-                                           workdir, "", timeLimit, memoryLimit);
-        if (result.exit_code != 0)
-          throw CPError<CPErrors::IR>(result.exit_code);
-        if (result.time > timeLimit)
-          throw CPError<CPErrors::TLE>();
-
-        _LOG(plog::info, "Time ~" << result.time << " seconds");
-
-        if (tests.UseStdOut) {
-          ofstream output(tdir / problem / tc.Name / tests.OutputFile);
-          output << result.stdout_data;
+        CheckRequest check;
+        check.contestantsDir = fs::canonical(slot.dir).string();
+        check.testsDir = (tdir / problem / tc.Name).string();
+        check.testOutputs = tests.OutputFile;
+        check.testName = problem;
+        check.input = tdir / problem / tc.Name / tests.InputFile;
+        check.expected = tdir / problem / tc.Name / tests.OutputFile;
+        check.output = slot.dir / tests.OutputFile;
+        check.timeLimit = timeLimit;
+        check.memoryLimit =
+            tc.MemoryLimit == -1 ? tests.MemoryLimit : tc.MemoryLimit;
+        check.timeUsed = result.time;
+        check.memoryUsed = result.memory;
+        if (batched) {
+          fs::path output = kept->path() / tc.Name;
+          if (fs::is_regular_file(check.output)) {
+            std::error_code ec;
+            fs::rename(check.output, output, ec);
+            if (ec) // another tmpfs
+              fs::copy_file(check.output, output);
+          }
+          check.output = output;
+          pending.push_back({&tc, std::move(check)});
+          return 0.0;
         }
+        if (checkers.enabled()) {
+          CheckerVerdict verdict = checkers.judge(evaluatorPath, check);
+          _LOG(plog::debug, "Checker " << verdict.seconds << "s, "
+                                       << verdict.memoryKb << "KB");
+          comments = std::move(verdict.comments);
+          _points = verdict.points;
+        } else
+          _points = call_evaluator(evaluator, check, comments);
       }
-      char *comments = nullptr;
-      double _points =
-          JudgeAPIFuncUTF8(fs::canonical(workdir).string().data(),
-                           (tdir / problem / tc.Name).string().data(),
-                           strdup(tests.OutputFile.data()), problem.data(),
-                           &comments) *
-          (tc.Mark == -1 ? tests.Mark : tc.Mark);
+      _points *= tc.Mark == -1 ? tests.Mark : tc.Mark;
 
       _LOG(plog::info, "[" << user << "/" << problem << "/" << tc.Name
                            << "]: " << _points << '\n'
                            << comments);
-      free(comments);
-      points += _points;
+      return _points;
     } catch (CPError<CPErrors::TLE> &e) {
       _LOG(plog::error, "[" << user << "/" << problem << "] TLEd " << tc.Name);
+    } catch (CPError<CPErrors::MLE> &e) {
+      _LOG(plog::error, "[" << user << "/" << problem << "] MLEd " << tc.Name);
+    } catch (CPError<CPErrors::ILE> &e) {
+      _LOG(plog::error, "[" << user << "/" << problem << "] ILEd " << tc.Name);
+    } catch (CPError<CPErrors::WA> &e) {
+      _LOG(plog::error, "[" << user << "/" << problem
+                            << "] wrong answer, stopped early in " << tc.Name);
+    } catch (CPError<CPErrors::RF> &e) {
+      _LOG(plog::error, "[" << user << "/" << problem
+                            << "] forbidden system call in " << tc.Name);
     } catch (CPError<CPErrors::IR> &e) {
       _LOG(plog::error, "[" << user << "/" << problem << "] exited with code 0x"
                             << std::hex << e.exit_code << std::dec);
@@ -321,15 +560,59 @@ void judge(fs::path subdir, fs::path tdir, string problem, string user,
       _LOG(plog::error,
            "[" << user << "/" << problem << "] critical error: " << e.what());
     }
+    return 0.0;
+  };
+
+  double points = 0.0;
+  for (std::size_t i = 0; i < width && i < subtests.size(); ++i)
+    launch(*slots[i], subtests[i]);
+  for (std::size_t i = 0; i < subtests.size(); ++i) {
+    Slot &slot = *slots[i % width];
+    points += conclude(slot);
+    if (i + width < subtests.size())
+      launch(slot, subtests[i + width]);
+  }
+
+  if (!pending.empty()) {
+    std::vector<CheckRequest> requests;
+    for (Pending &p : pending)
+      requests.push_back(std::move(p.check));
+    std::vector<std::string> comments;
+    std::vector<double> scores(pending.size(), 0.0);
+    try {
+      scores = call_evaluator_batch(evaluator, requests, comments);
+    } catch (std::exception &e) {
+      comments.assign(pending.size(), {});
+      _LOG(plog::error,
+           "[" << user << "/" << problem << "] critical error: " << e.what());
+    }
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+      const Subtest &tc = *pending[i].tc;
+      double _points = scores[i] * (tc.Mark == -1 ? tests.Mark : tc.Mark);
+      _LOG(plog::info, "[" << user << "/" << problem << "/" << tc.Name
+                           << "]: " << _points << '\n'
+                           << comments[i]);
+      points += _points;
+    }
   }
 
   _LOG(plog::info, "[" << user << "/" << problem << "]: " << points);
-#undef _LOG
   out.close();
-  scores[std::make_pair(user, problem)] = std::make_pair("V", points);
+  set_score(user, problem, "V", points);
+}
+#undef _LOG
+
+void judge(fs::path subdir, fs::path tdir, string problem, string user,
+           const Configuration &conf,
+           const unordered_map<string, Testcases> &testcases,
+           fs::path &judger_path, int index) {
+  if (auto submission = compile_submission(subdir, tdir, problem, user, conf,
+                                           testcases, index))
+    test_submission(*submission, judger_path);
 }
 
 std::map<std::pair<string, string>, std::pair<std::string, double>>
 getScores() {
+  std::lock_guard<std::mutex> lock(scores_mutex);
   return scores;
 }
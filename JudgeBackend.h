@@ -2,13 +2,35 @@
 #include "Base.h"
 #include <filesystem>
 #include <map>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <variant>
+#include <vector>
+// Safe to call from several threads at once. `index` numbers the
+// $History report; take it from next_judge_index() in the order the
+// submissions would be judged serially, so parallel runs name them alike.
 void judge(std::filesystem::path subdir, std::filesystem::path tdir,
            std::string problem, std::string user, const Configuration &conf,
            const std::unordered_map<std::string, Testcases> &testcases,
-           std::filesystem::path &judger_path);
+           std::filesystem::path &judger_path, int index);
+int next_judge_index();
+
+// judge() as its two stages, so that later submissions can compile while
+// earlier ones are being tested. compile_submission() returns nullptr when
+// the submission already has its verdict (no source, compile error, ...).
+struct CompiledSubmission;
+std::shared_ptr<CompiledSubmission>
+compile_submission(std::filesystem::path subdir, std::filesystem::path tdir,
+                   std::string problem, std::string user,
+                   const Configuration &conf,
+                   const std::unordered_map<std::string, Testcases> &testcases,
+                   int index);
+void test_submission(CompiledSubmission &submission,
+                     std::filesystem::path &judger_path);
 std::map<std::pair<std::string, std::string>, std::pair<std::string, double>>
 getScores();
+// The names in an "a|b|c" OutputFile, skipping empty ones as the evaluator
+// libraries' strtok() does
+std::vector<std::string> split_output_files(const std::string &list);
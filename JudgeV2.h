@@ -0,0 +1,56 @@
+#pragma once
+// Checker ABI v2, plain C so that evaluators can include it.
+//
+// An evaluator may export JudgeV2 next to (or instead of) the legacy Judge;
+// the judger prefers JudgeV2 when it finds it. Instead of directories to
+// rebuild paths from, a v2 checker gets the test's input, answer and the
+// contestant's output already in memory, the subtest's limits and what the
+// run used, and writes its comments through a callback: no path handling,
+// no file I/O and no comment buffer of its own.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JUDGE_ABI_VERSION 2
+
+// Read-only bytes, valid for the duration of the call; not NUL-terminated
+typedef struct JudgeSpan {
+  const char *data;
+  size_t size;
+} JudgeSpan;
+
+typedef struct JudgeRequestV2 {
+  uint32_t version; // JUDGE_ABI_VERSION the judger was built with
+  uint32_t size;    // sizeof(JudgeRequestV2) there; fields are only appended
+  JudgeSpan input;    // the test's input file
+  JudgeSpan expected; // the test's answer file
+  JudgeSpan output;   // the contestant's output; empty when there is none
+  const char *testName; // UTF-8 on every platform
+  double timeLimit;     // seconds
+  double memoryLimit;   // MiB
+  double timeUsed;      // seconds of CPU time
+  uint64_t memoryUsed;  // KiB, peak
+  // Appends `size` bytes of UTF-8 to the comments; may be called any number
+  // of times, always with `context`
+  void (*comment)(void *context, const char *text, size_t size);
+  void *context;
+} JudgeRequestV2;
+
+// [0.0, 1.0] like Judge(). Exported as JudgeV2 with the C calling convention
+typedef double (*JudgeV2Fn)(const JudgeRequestV2 *request);
+
+// Optional, exported as JudgeBatchV2: every subtest of one submission in a
+// single call, so that parsed state, threads or buffers can be shared
+// across them. scores[i] gets what JudgeV2 would return for requests[i];
+// each request has its own comment context. Used instead of JudgeV2 when
+// the problem has a single output file
+typedef void (*JudgeBatchV2Fn)(const JudgeRequestV2 *requests, size_t count,
+                               double *scores);
+
+#ifdef __cplusplus
+}
+#endif
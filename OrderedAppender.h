@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <plog/Appenders/IAppender.h>
+#include <plog/Formatters/TxtFormatter.h>
+#include <plog/Record.h>
+#include <plog/Util.h>
+#include <set>
+#include <vector>
+
+// Keeps --jobs console output in serial order. Records logged while a
+// thread judges submission `index` (see Scope) are held back until every
+// earlier submission has finished; the oldest unfinished one is written
+// through as it runs. Records outside any Scope are written at once.
+// Held-back lines lose their colour.
+class OrderedAppender : public plog::IAppender {
+public:
+  explicit OrderedAppender(plog::IAppender &inner) : inner_(inner) {}
+
+  // Starts ordering at `first`, the lowest index about to be judged
+  void start(int first) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ordered_ = true;
+    head_ = first;
+  }
+
+  // Tags this thread's records with `index` for its lifetime
+  class Scope {
+  public:
+    explicit Scope(int index) : saved_(current_) { current_ = index; }
+    ~Scope() { current_ = saved_; }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    int saved_;
+  };
+
+  void write(const plog::Record &record) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ordered_ || current_ < 0 || current_ <= head_) {
+      inner_.write(record);
+      return;
+    }
+    held_[current_].push_back(plog::TxtFormatter::format(record));
+  }
+
+  // Submission `index` logs nothing more; flushes whatever it unblocks
+  void finish(int index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ordered_)
+      return;
+    done_.insert(index);
+    while (done_.erase(head_)) {
+      ++head_;
+      auto it = held_.find(head_);
+      if (it == held_.end())
+        continue;
+      for (auto &line : it->second)
+        put(line);
+      std::fflush(stdout);
+      held_.erase(it);
+    }
+  }
+
+private:
+  static void put(const plog::util::nstring &line) {
+#ifdef _WIN32
+    std::string s = plog::util::toNarrow(line, CP_UTF8);
+#else
+    const std::string &s = line;
+#endif
+    std::fwrite(s.data(), 1, s.size(), stdout);
+  }
+
+  plog::IAppender &inner_;
+  std::mutex mutex_;
+  bool ordered_ = false;
+  int head_ = 0;
+  std::map<int, std::vector<plog::util::nstring>> held_;
+  std::set<int> done_;
+  static inline thread_local int current_ = -1;
+};
@@ -1,21 +1,665 @@
 #include "ProcessIO.h"
+#include "Cgroup.h"
+#include "Comparators.h"
+#include "CoreAllocator.h"
+#include "Reactor.h"
+#include "Spawn.h"
+#include <algorithm>
 #include <chrono>
-#include <iostream>
+#include <memory>
 #include <signal.h>
+#include <thread>
 
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <cerrno>
 #include <fcntl.h>
+#include <fstream>
+#include <pthread.h>
 #include <signal.h>
+#include <sstream>
+#include <sys/epoll.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 #include <sys/times.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #endif
 using std::min;
+
+#ifndef _WIN32
+namespace {
+// Owns a file descriptor and closes it on scope exit, so that every early
+// throw out of run_command() releases the pipes/epoll/timer fds.
+class UniqueFd {
+public:
+  UniqueFd() = default;
+  explicit UniqueFd(int fd) : fd_(fd) {}
+  UniqueFd(const UniqueFd &) = delete;
+  UniqueFd &operator=(const UniqueFd &) = delete;
+  ~UniqueFd() { reset(); }
+
+  void reset(int fd = -1) {
+    if (fd_ >= 0)
+      close(fd_);
+    fd_ = fd;
+  }
+  operator int() const { return fd_; }
+
+private:
+  int fd_ = -1;
+};
+
+constexpr size_t kPipeSize = (size_t)1 << 20;
+
+// Blocks SIGPIPE for the calling thread while a run is being driven and
+// swallows any instance raised by writing to a child that stopped reading.
+class SigpipeGuard {
+public:
+  SigpipeGuard() {
+    sigemptyset(&pipe_);
+    sigaddset(&pipe_, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_, &old_);
+  }
+  ~SigpipeGuard() {
+    timespec zero{};
+    while (sigtimedwait(&pipe_, nullptr, &zero) > 0)
+      ;
+    pthread_sigmask(SIG_SETMASK, &old_, nullptr);
+  }
+
+private:
+  sigset_t pipe_, old_;
+};
+
+timespec to_timespec(float secs) {
+  timespec ts{};
+  ts.tv_sec = (time_t)secs;
+  ts.tv_nsec = (long)((secs - (float)ts.tv_sec) * 1e9f);
+  if (ts.tv_sec == 0 && ts.tv_nsec == 0)
+    ts.tv_nsec = 1; // a zero it_value would disarm the timer
+  return ts;
+}
+
+// utime + stime + cutime + cstime from /proc/<pid>/stat, in clock ticks, over
+// the process tree: CPU used so far by the process, its threads and all of
+// its descendants, running or reaped
+uint64_t proc_cpu_ticks(pid_t pid) {
+  std::ifstream f("/proc/" + std::to_string(pid) + "/stat");
+  std::string stat;
+  std::getline(f, stat);
+  // comm may contain spaces and parentheses; the fields follow the last ')'
+  auto paren = stat.rfind(')');
+  if (paren == std::string::npos)
+    return 0;
+  std::istringstream fields(stat.substr(paren + 1));
+  std::string skip;
+  for (int i = 0; i < 11; ++i) // state .. cmajflt
+    fields >> skip;
+  uint64_t ticks = 0, v;
+  for (int i = 0; i < 4 && fields >> v; ++i)
+    ticks += v;
+
+  // Plus the children still running, found through each thread's
+  // task/<tid>/children list
+  std::error_code ec;
+  fs::path tasks = "/proc/" + std::to_string(pid) + "/task";
+  for (const auto &task : fs::directory_iterator(tasks, ec)) {
+    std::ifstream children(task.path() / "children");
+    pid_t child;
+    while (children >> child)
+      ticks += proc_cpu_ticks(child);
+  }
+  return ticks;
+}
+
+// One run on POSIX, from spawn to verdict. Everything the run can be waiting
+// on lives in its own epoll set: the pidfd becomes readable when the child
+// exits, the timerfd when the wall-clock limit expires, and the pipes when
+// there is output to drain. step() handles whatever is ready; run_command()
+// blocks on the set, run_command_async() lets the Reactor poll it.
+class PosixRun {
+public:
+  PosixRun(const std::vector<std::string> &command, const fs::path &cwd,
+           const RunOptions &options, CoreAllocator::Lease core);
+  ~PosixRun(); // kills a run that is abandoned before the child exited
+
+  // the epoll set, readable whenever step() has something to do
+  int poll_fd() const { return ep_; }
+  // Waits up to `timeout_ms` (-1: forever) and handles what is ready; true
+  // once the child is gone. Throws the verdict (TLE, OLE, WA, ILE) after
+  // killing the run.
+  bool step(int timeout_ms);
+  // Verdicts that need the exit status, then the result; call once
+  ProcessResult result();
+
+private:
+  bool reap(int flags);
+  void kill_child();
+  void watch(int fd, uint32_t events = EPOLLIN);
+  void feed();
+  void close_stdin();
+  bool drain(int fd, std::string &dst);
+  uint64_t cpu_used() const;
+
+  RunOptions options_;
+  CoreAllocator::Lease core_;
+  std::chrono::high_resolution_clock::time_point start_wall_;
+
+  // The judger's ends of the pipes; with stdin_file/stdout_file the test
+  // files are attached directly and the corresponding pipe is never created
+  UniqueFd in_fd_, out_fd_, err_fd_;
+  bool limit_fsize_;
+  uint64_t memoryBytes_;
+  std::unique_ptr<CgroupLeaf> own_cgroup_;
+  CgroupLeaf *cgroup_;
+  bool count_instructions_;
+
+  pid_t pid_ = -1;
+  UniqueFd ep_, proc_fd_, deadline_;
+  UniqueFd tick_; // only used when pidfds are unavailable (Linux < 5.3)
+  UniqueFd instructions_fd_, cycles_fd_;
+  UniqueFd budget_tick_; // polls the instruction counter
+  UniqueFd idle_tick_;   // samples CPU usage for options.idleTimeout
+
+  bool reaped_ = false;
+  int status_ = 0;
+  struct rusage usage_ {};
+  IoCounters io_;
+
+  size_t stdin_off_ = 0;
+  uint64_t last_cpu_ = 0;
+  std::chrono::steady_clock::time_point last_active_;
+
+  std::string out_buf_, err_buf_;
+  std::vector<char> buf_;
+  int open_pipes_;
+  std::size_t streamed_ = 0; // stdout bytes handed to options.comparator
+  bool finished_ = false;
+};
+
+uint64_t read_counter(int fd) {
+  uint64_t value = 0;
+  if (fd >= 0 && read(fd, &value, sizeof(value)) != sizeof(value))
+    value = 0;
+  return value;
+}
+
+PosixRun::PosixRun(const std::vector<std::string> &command,
+                   const fs::path &cwd, const RunOptions &options,
+                   CoreAllocator::Lease core)
+    : options_(options), core_(std::move(core)),
+      start_wall_(std::chrono::high_resolution_clock::now()),
+      buf_(65536) {
+  const std::size_t maxOutputBytes = options_.maxOutputBytes;
+  const float time_limit_sec = options_.time;
+
+  // What becomes the child's fd 0/1/2
+  UniqueFd child_in, child_out, child_err;
+
+  auto make_pipe = [](UniqueFd &read_end, UniqueFd &write_end) {
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0)
+      throw CPError<CPErrors::IE>("pipe creation failed");
+    read_end.reset(p[0]);
+    write_end.reset(p[1]);
+    // The default 64 KiB pipes cost a context switch per 64 KiB moved;
+    // larger buffers let big tests stream at memory bandwidth. Failure just
+    // leaves the default size (e.g. above /proc/sys/fs/pipe-max-size).
+    fcntl(p[1], F_SETPIPE_SZ, (int)kPipeSize);
+  };
+
+  if (!options_.stdin_file.empty()) {
+    child_in.reset(open(options_.stdin_file.c_str(), O_RDONLY | O_CLOEXEC));
+    if (child_in < 0)
+      throw CPError<CPErrors::IE>("cannot open " +
+                                  options_.stdin_file.string());
+  } else {
+    make_pipe(child_in, in_fd_);
+  }
+  if (!options_.stdout_file.empty()) {
+    child_out.reset(open(options_.stdout_file.c_str(),
+                         O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (child_out < 0)
+      throw CPError<CPErrors::IE>("cannot create " +
+                                  options_.stdout_file.string());
+  } else {
+    make_pipe(out_fd_, child_out);
+  }
+  make_pipe(err_fd_, child_err);
+
+  limit_fsize_ = !options_.stdout_file.empty();
+
+  // Each run gets its own cgroup v2 leaf with memory.max/pids.max unless the
+  // caller lends one; where that is unavailable the address space is capped
+  // with RLIMIT_AS instead
+  memoryBytes_ =
+      options_.maxMemory > 0 ? (uint64_t)options_.maxMemory << 20 : 0;
+  cgroup_ = options_.cgroup;
+  if (!cgroup_) {
+    own_cgroup_ = CgroupLeaf::create(run_memory_max(options_),
+                                     (uint64_t)options_.maxProcesses);
+    cgroup_ = own_cgroup_.get();
+  }
+
+  std::string exe = resolve_executable(command.at(0));
+  std::vector<char *> argv;
+  for (const auto &s : command)
+    argv.push_back(const_cast<char *>(s.c_str()));
+  argv.push_back(nullptr);
+
+  ChildSetup setup;
+  setup.stdin_fd = child_in;
+  setup.stdout_fd = child_out;
+  setup.stderr_fd = child_err;
+  setup.cwd = cwd.c_str();
+  setup.path = exe.c_str();
+  setup.argv = argv.data();
+  if (limit_fsize_)
+    setup.fsize = maxOutputBytes;
+  if (cgroup_)
+    setup.cgroup_procs_fd = cgroup_->procs_fd();
+  else if (memoryBytes_)
+    setup.as = memoryBytes_;
+  setup.cpu = core_.cpu();
+
+  std::vector<sock_filter> filter;
+  sock_fprog seccomp{};
+  if (options_.seccomp != SeccompProfile::None) {
+    filter = build_seccomp_filter(options_.seccomp, setup.path);
+    if (filter.empty())
+      throw CPError<CPErrors::IE>(
+          "ActiveSecurity is not supported on this architecture");
+    seccomp.len = (unsigned short)filter.size();
+    seccomp.filter = filter.data();
+    setup.seccomp = &seccomp;
+  }
+
+  // The perf counters have to be opened by the child itself so that they
+  // follow it from execve() on; it sends them back over this socket
+  count_instructions_ = options_.instructionLimit > 0;
+  UniqueFd perf_sock, child_perf_sock;
+  if (count_instructions_) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+      throw CPError<CPErrors::IE>("socketpair failed");
+    perf_sock.reset(sv[0]);
+    child_perf_sock.reset(sv[1]);
+    setup.perf_sock = child_perf_sock;
+  }
+
+  pid_ = spawn_child(setup);
+  if (pid_ < 0)
+    throw CPError<CPErrors::IE>("failed to spawn process");
+
+  // Parent process
+  child_in.reset();
+  child_out.reset();
+  child_err.reset();
+  child_perf_sock.reset();
+
+  if (in_fd_ >= 0)
+    fcntl(in_fd_, F_SETFL, O_NONBLOCK);
+  if (out_fd_ >= 0)
+    fcntl(out_fd_, F_SETFL, O_NONBLOCK);
+  fcntl(err_fd_, F_SETFL, O_NONBLOCK);
+
+  ep_.reset(epoll_create1(EPOLL_CLOEXEC));
+  proc_fd_.reset(open_pidfd(pid_));
+  deadline_.reset(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC));
+
+  if (ep_ < 0 || deadline_ < 0) {
+    kill_child();
+    throw CPError<CPErrors::IE>("epoll/timerfd creation failed");
+  }
+
+  if (count_instructions_) {
+    // Blocks until the child is about to exec (or died trying)
+    int fds[kMaxPassedFds], nfds = 0;
+    char count;
+    recv_fds(perf_sock, &count, 1, fds, nfds);
+    perf_sock.reset();
+    if (nfds > 0)
+      instructions_fd_.reset(fds[0]);
+    if (nfds > 1)
+      cycles_fd_.reset(fds[1]);
+    for (int i = 2; i < nfds; ++i)
+      close(fds[i]);
+    if (nfds < 2) {
+      kill_child();
+      throw CPError<CPErrors::IE>(
+          "perf_event_open failed (no hardware counters, or "
+          "kernel.perf_event_paranoid too high)");
+    }
+    budget_tick_.reset(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC));
+    if (budget_tick_ < 0) {
+      kill_child();
+      throw CPError<CPErrors::IE>("timerfd creation failed");
+    }
+  }
+
+  // Instruction budgets are checked every 10 ms; the wall-clock deadline
+  // only catches runs that sleep or block, so give it some slack
+  itimerspec its{};
+  its.it_value = to_timespec(count_instructions_
+                                 ? std::max(2 * time_limit_sec,
+                                            time_limit_sec + 1.0f)
+                                 : time_limit_sec);
+  timerfd_settime(deadline_, 0, &its, nullptr);
+  watch(deadline_);
+  if (budget_tick_ >= 0) {
+    itimerspec period{};
+    period.it_value = period.it_interval = to_timespec(0.01f);
+    timerfd_settime(budget_tick_, 0, &period, nullptr);
+    watch(budget_tick_);
+  }
+  watch(err_fd_);
+  if (out_fd_ >= 0)
+    watch(out_fd_);
+  open_pipes_ = out_fd_ >= 0 ? 2 : 1;
+
+  // stdin is fed from the same loop that drains the output, so a program
+  // that writes while it reads can never deadlock against us.
+  if (options_.stdin_data.empty())
+    close_stdin();
+  else if (in_fd_ >= 0)
+    watch(in_fd_, EPOLLOUT);
+
+  // Idle detection: CPU usage of the whole run (cgroup) or of the child and
+  // its reaped children, sampled a few times per idle window
+  last_active_ = std::chrono::steady_clock::now();
+  if (options_.idleTimeout > 0) {
+    idle_tick_.reset(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC));
+    itimerspec period{};
+    period.it_value = period.it_interval =
+        to_timespec(std::clamp(options_.idleTimeout / 4, 0.01f, 0.25f));
+    timerfd_settime(idle_tick_, 0, &period, nullptr);
+    watch(idle_tick_);
+    last_cpu_ = cpu_used();
+  }
+
+  if (proc_fd_ >= 0) {
+    watch(proc_fd_);
+  } else {
+    tick_.reset(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC));
+    itimerspec period{};
+    period.it_value = period.it_interval = to_timespec(0.01f);
+    timerfd_settime(tick_, 0, &period, nullptr);
+    watch(tick_);
+  }
+}
+
+bool PosixRun::reap(int flags) {
+  reaped_ = reap_child(pid_, flags, status_, usage_, io_);
+  return reaped_;
+}
+
+PosixRun::~PosixRun() {
+  if (pid_ > 0 && !reaped_)
+    kill_child();
+}
+
+void PosixRun::kill_child() {
+  if (cgroup_)
+    cgroup_->kill();
+  if (proc_fd_ < 0 || signal_pidfd(proc_fd_, SIGKILL) < 0)
+    kill(pid_, SIGKILL);
+  reap(0); // Reap zombie
+}
+
+void PosixRun::watch(int fd, uint32_t events) {
+  epoll_event ev{};
+  ev.events = events;
+  ev.data.fd = fd;
+  epoll_ctl(ep_, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void PosixRun::close_stdin() {
+  if (in_fd_ < 0)
+    return;
+  epoll_ctl(ep_, EPOLL_CTL_DEL, in_fd_, nullptr);
+  in_fd_.reset();
+}
+
+void PosixRun::feed() {
+  const std::string_view stdin_data = options_.stdin_data;
+  while (stdin_off_ < stdin_data.size()) {
+    ssize_t w = write(in_fd_, stdin_data.data() + stdin_off_,
+                      std::min(stdin_data.size() - stdin_off_, kPipeSize));
+    if (w > 0) {
+      stdin_off_ += (size_t)w;
+      continue;
+    }
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w < 0 && errno == EAGAIN)
+      return;
+    break; // EPIPE: the child closed its stdin, the rest is discarded
+  }
+  close_stdin();
+}
+
+// Returns false once the pipe has hit EOF and was removed from the set
+bool PosixRun::drain(int fd, std::string &dst) {
+  for (;;) {
+    ssize_t r = read(fd, buf_.data(), buf_.size());
+    if (r > 0 && fd == out_fd_ && options_.comparator) {
+      streamed_ += (size_t)r;
+      if (streamed_ > options_.maxOutputBytes) {
+        kill_child();
+        throw CPError<CPErrors::OLE>();
+      }
+      if (!options_.comparator->feed({buf_.data(), (size_t)r})) {
+        kill_child();
+        throw CPError<CPErrors::WA>();
+      }
+      continue;
+    }
+    if (r > 0) {
+      dst.append(buf_.data(), (size_t)r);
+      if (dst.size() > options_.maxOutputBytes) {
+        kill_child();
+        throw CPError<CPErrors::OLE>();
+      }
+      continue;
+    }
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r == 0) {
+      epoll_ctl(ep_, EPOLL_CTL_DEL, fd, nullptr);
+      --open_pipes_;
+      return false;
+    }
+    return true; // EAGAIN
+  }
+}
+
+uint64_t PosixRun::cpu_used() const {
+  return cgroup_ ? cgroup_->cpu_usage_usec() : proc_cpu_ticks(pid_);
+}
+
+bool PosixRun::step(int timeout_ms) {
+  epoll_event events[8];
+  int n = epoll_wait(ep_, events, 8, timeout_ms);
+  if (n < 0) {
+    if (errno == EINTR)
+      return false;
+    kill_child();
+    throw CPError<CPErrors::IE>("epoll_wait failed");
+  }
+
+  for (int i = 0; i < n && !finished_; ++i) {
+    int fd = events[i].data.fd;
+    if (fd == in_fd_)
+      feed();
+    else if (fd == out_fd_)
+      drain(out_fd_, out_buf_);
+    else if (fd == err_fd_)
+      drain(err_fd_, err_buf_);
+    else if (fd == deadline_) {
+      kill_child();
+      throw CPError<CPErrors::TLE>();
+    } else if (fd == idle_tick_) {
+      uint64_t expirations;
+      read(idle_tick_, &expirations, sizeof(expirations));
+      auto now = std::chrono::steady_clock::now();
+      uint64_t used = cpu_used();
+      if (used != last_cpu_) {
+        last_cpu_ = used;
+        last_active_ = now;
+      } else if (std::chrono::duration<float>(now - last_active_).count() >=
+                 options_.idleTimeout) {
+        // Exiting also stops the CPU clock; that's not being idle
+        if (reap(WNOHANG)) {
+          finished_ = true;
+          continue;
+        }
+        kill_child();
+        throw CPError<CPErrors::ILE>();
+      }
+    } else if (fd == budget_tick_) {
+      uint64_t expirations;
+      read(budget_tick_, &expirations, sizeof(expirations));
+      if (read_counter(instructions_fd_) > options_.instructionLimit) {
+        kill_child();
+        throw CPError<CPErrors::TLE>();
+      }
+    } else if (fd == proc_fd_ || fd == tick_) {
+      if (fd == tick_) {
+        uint64_t expirations;
+        read(tick_, &expirations, sizeof(expirations));
+      }
+      if (reap(WNOHANG))
+        finished_ = true;
+    }
+  }
+  return finished_;
+}
+
+ProcessResult PosixRun::result() {
+  close_stdin();
+
+  // The child is gone, but anything it wrote before exiting may still sit in
+  // the pipes. Don't wait for EOF: a stray grandchild could hold them open.
+  if (open_pipes_) {
+    if (out_fd_ >= 0)
+      drain(out_fd_, out_buf_);
+    drain(err_fd_, err_buf_);
+  }
+
+  // A lent leaf outlives the run; nothing started by the run may
+  if (options_.cgroup)
+    options_.cgroup->kill();
+
+  auto end_wall = std::chrono::high_resolution_clock::now();
+  float wall_secs =
+      std::chrono::duration<float>(end_wall - start_wall_).count();
+
+  // CPU time from the child-specific rusage (not accumulated across calls)
+  float user_cpu_time = usage_.ru_utime.tv_sec + usage_.ru_utime.tv_usec / 1e6;
+  float system_cpu_time =
+      usage_.ru_stime.tv_sec + usage_.ru_stime.tv_usec / 1e6;
+  float cpu_secs = user_cpu_time + system_cpu_time;
+
+  // Counts of exited threads and children are folded into the counters
+  uint64_t instructions = read_counter(instructions_fd_);
+  uint64_t cycles = read_counter(cycles_fd_);
+
+  // memory.peak covers the whole run including grandchildren; ru_maxrss is
+  // the largest single process and the only figure without cgroups
+  uint64_t peak_kb = cgroup_ ? cgroup_->memory_peak_kb() : 0;
+  if (peak_kb && !options_.stdout_file.empty()) {
+    // The output file's pages are in there too; see run_memory_max()
+    std::error_code size_ec;
+    uint64_t out_kb = fs::file_size(options_.stdout_file, size_ec) / 1024;
+    peak_kb = size_ec ? peak_kb : peak_kb - std::min(peak_kb - 1, out_kb);
+  }
+  if (!peak_kb)
+    peak_kb = (uint64_t)usage_.ru_maxrss;
+  if (memoryBytes_ &&
+      ((cgroup_ && cgroup_->oom_killed()) || peak_kb * 1024 > memoryBytes_))
+    throw CPError<CPErrors::MLE>();
+
+  // The redirected output hit RLIMIT_FSIZE
+  if (WIFSIGNALED(status_) && WTERMSIG(status_) == SIGXFSZ && limit_fsize_)
+    throw CPError<CPErrors::OLE>();
+  // A syscall outside the seccomp profile
+  if (WIFSIGNALED(status_) && WTERMSIG(status_) == SIGSYS &&
+      options_.seccomp != SeccompProfile::None)
+    throw CPError<CPErrors::RF>();
+
+  uint32_t ec = 0;
+  if (WIFEXITED(status_))
+    ec = (uint32_t)WEXITSTATUS(status_);
+  else if (WIFSIGNALED(status_))
+    ec = 128 + (uint32_t)WTERMSIG(status_); // Common convention for signal exit
+
+  // Check the time limit after process exits
+  if (count_instructions_ ? instructions > options_.instructionLimit
+                          : cpu_secs > options_.time)
+    throw CPError<CPErrors::TLE>();
+
+  ProcessResult result{std::move(out_buf_), std::move(err_buf_), ec, cpu_secs,
+                       peak_kb, instructions, cycles};
+  result.wall = wall_secs;
+  result.user_time = user_cpu_time;
+  result.sys_time = system_cpu_time;
+  result.minor_faults = (uint64_t)usage_.ru_minflt;
+  result.major_faults = (uint64_t)usage_.ru_majflt;
+  result.voluntary_switches = (uint64_t)usage_.ru_nvcsw;
+  result.involuntary_switches = (uint64_t)usage_.ru_nivcsw;
+  result.bytes_read = io_.read;
+  result.bytes_written = io_.written;
+  result.signal = WIFSIGNALED(status_) ? WTERMSIG(status_) : 0;
+  return result;
+}
+
+// Drives one PosixRun from the reactor thread and reports its outcome
+class AsyncRun : public Reactor::Source {
+public:
+  AsyncRun(std::unique_ptr<PosixRun> run, RunCallback done)
+      : run_(std::move(run)), done_(std::move(done)) {}
+
+  // Hands the run over to the reactor thread
+  static void start(std::unique_ptr<PosixRun> run, RunCallback done) {
+    int fd = run->poll_fd();
+    auto *self = new AsyncRun(std::move(run), std::move(done));
+    if (Reactor::instance().add(fd, self))
+      return;
+    RunCallback failed = std::move(self->done_);
+    delete self; // kills the child
+    failed({}, std::make_exception_ptr(
+                   CPError<CPErrors::IE>("cannot watch the run")));
+  }
+
+  void ready() override {
+    ProcessResult result{};
+    std::exception_ptr error;
+    try {
+      if (!run_->step(0))
+        return;
+      result = run_->result();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    Reactor::instance().remove(run_->poll_fd());
+    // Frees the run's cgroup and CPU before the caller hears back
+    run_.reset();
+    RunCallback done = std::move(done_);
+    delete this;
+    done(std::move(result), error);
+  }
+
+private:
+  std::unique_ptr<PosixRun> run_;
+  RunCallback done_;
+};
+} // namespace
+#endif
 std::string
 expand_percent_vars(std::string_view input,
                     const std::unordered_map<std::string, std::string> &vars) {
@@ -44,14 +688,40 @@ expand_percent_vars(std::string_view input,
   return out;
 }
 
+uint64_t run_memory_max(const RunOptions &options) {
+  if (options.maxMemory <= 0)
+    return 0;
+  uint64_t bytes = (uint64_t)options.maxMemory << 20;
+  if (!options.stdout_file.empty())
+    bytes += options.maxOutputBytes;
+  return bytes;
+}
+
 ProcessResult run_command(const std::vector<std::string> &command,
                           const fs::path &cwd, const std::string &stdin_data,
                           const float time_limit_sec, const int maxMemoryMB) {
-  const std::size_t maxOutputBytes = (std::size_t)32 * 1024 * 1024;
+  RunOptions options;
+  options.time = time_limit_sec;
+  options.maxMemory = maxMemoryMB;
+  options.stdin_data = stdin_data;
+  return run_command(command, cwd, options);
+}
 
-  auto start_wall = std::chrono::high_resolution_clock::now();
+ProcessResult run_command(const std::vector<std::string> &command,
+                          const fs::path &cwd, const RunOptions &options) {
+  // Taken before the clock starts: waiting for a CPU is not the run's time
+  CoreAllocator::Lease core;
+  if (options.exclusiveCore)
+    core = CoreAllocator::instance().acquire();
 
 #ifdef _WIN32
+  const std::size_t maxOutputBytes = options.maxOutputBytes;
+  const float time_limit_sec = options.time;
+  const std::string_view stdin_data = options.stdin_data;
+  auto start_wall = std::chrono::high_resolution_clock::now();
+
+  if (options.instructionLimit)
+    throw CPError<CPErrors::IE>("instruction counting is not supported");
 
   HANDLE inRd, inWr, outRd, outWr, errRd, errWr;
   SECURITY_ATTRIBUTES sa{sizeof(sa), nullptr, TRUE};
@@ -65,6 +735,25 @@ ProcessResult run_command(const std::vector<std::string> &command,
   SetHandleInformation(outWr, 0, HANDLE_FLAG_INHERIT);
   SetHandleInformation(errWr, 0, HANDLE_FLAG_INHERIT);
 
+  // Test files handed straight to the child instead of going through pipes
+  HANDLE inFile = INVALID_HANDLE_VALUE, outFile = INVALID_HANDLE_VALUE;
+  if (!options.stdin_file.empty()) {
+    inFile = CreateFileW(options.stdin_file.wstring().c_str(), GENERIC_READ,
+                         FILE_SHARE_READ, &sa, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (inFile == INVALID_HANDLE_VALUE)
+      throw CPError<CPErrors::IE>("cannot open " +
+                                  options.stdin_file.string());
+  }
+  if (!options.stdout_file.empty()) {
+    outFile = CreateFileW(options.stdout_file.wstring().c_str(),
+                          GENERIC_WRITE, FILE_SHARE_READ, &sa, CREATE_ALWAYS,
+                          FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (outFile == INVALID_HANDLE_VALUE)
+      throw CPError<CPErrors::IE>("cannot create " +
+                                  options.stdout_file.string());
+  }
+
   std::wstring cmdline;
   for (size_t i = 0; i < command.size(); ++i) {
     if (i)
@@ -80,8 +769,8 @@ ProcessResult run_command(const std::vector<std::string> &command,
   STARTUPINFOW si{};
   si.cb = sizeof(si);
   si.dwFlags = STARTF_USESTDHANDLES;
-  si.hStdInput = inRd;
-  si.hStdOutput = outWr;
+  si.hStdInput = inFile != INVALID_HANDLE_VALUE ? inFile : inRd;
+  si.hStdOutput = outFile != INVALID_HANDLE_VALUE ? outFile : outWr;
   si.hStdError = errWr;
 
   std::wstring wcwd = cwd.wstring();
@@ -93,6 +782,10 @@ ProcessResult run_command(const std::vector<std::string> &command,
   CloseHandle(inRd);
   CloseHandle(outWr);
   CloseHandle(errWr);
+  if (inFile != INVALID_HANDLE_VALUE)
+    CloseHandle(inFile);
+  if (outFile != INVALID_HANDLE_VALUE)
+    CloseHandle(outFile);
 
   if (!stdin_data.empty()) {
     DWORD written;
@@ -102,7 +795,10 @@ ProcessResult run_command(const std::vector<std::string> &command,
   CloseHandle(inWr);
 
   std::string out_buf, err_buf;
+  std::size_t streamed = 0; // stdout bytes handed to options.comparator
   char buffer[4096];
+  float last_cpu = 0;
+  auto last_active = std::chrono::high_resolution_clock::now();
 
   while (true) {
 
@@ -118,8 +814,17 @@ ProcessResult run_command(const std::vector<std::string> &command,
                     &nread, nullptr))
         break;
 
-      out_buf.append(buffer, nread);
-      if (out_buf.size() > maxOutputBytes) {
+      if (options.comparator && outFile == INVALID_HANDLE_VALUE) {
+        streamed += nread;
+        if (!options.comparator->feed({buffer, nread})) {
+          TerminateProcess(pi.hProcess, 1);
+          Sleep(1000);
+          throw CPError<CPErrors::WA>();
+        }
+      } else {
+        out_buf.append(buffer, nread);
+      }
+      if (out_buf.size() > maxOutputBytes || streamed > maxOutputBytes) {
         TerminateProcess(pi.hProcess, 1);
         Sleep(1000);
         throw CPError<CPErrors::OLE>();
@@ -160,6 +865,19 @@ ProcessResult run_command(const std::vector<std::string> &command,
       throw CPError<CPErrors::TLE>();
     }
 
+    // No CPU used for the whole idle window
+    auto now_idle = std::chrono::high_resolution_clock::now();
+    if (cpu_secs != last_cpu) {
+      last_cpu = cpu_secs;
+      last_active = now_idle;
+    } else if (options.idleTimeout > 0 && waitResult != WAIT_OBJECT_0 &&
+               std::chrono::duration<float>(now_idle - last_active).count() >=
+                   options.idleTimeout) {
+      TerminateProcess(pi.hProcess, 1);
+      Sleep(1000);
+      throw CPError<CPErrors::ILE>();
+    }
+
     // Check wall time
     auto now_wall = std::chrono::high_resolution_clock::now();
     float wall_secs =
@@ -189,6 +907,12 @@ ProcessResult run_command(const std::vector<std::string> &command,
 
   float cpu_secs = (float)((k.QuadPart + u.QuadPart) * 1e-7);
 
+  IO_COUNTERS io{};
+  GetProcessIoCounters(pi.hProcess, &io);
+  float wall_secs = std::chrono::duration<float>(
+                        std::chrono::high_resolution_clock::now() - start_wall)
+                        .count();
+
   CloseHandle(pi.hProcess);
   CloseHandle(pi.hThread);
   CloseHandle(outRd);
@@ -198,146 +922,78 @@ ProcessResult run_command(const std::vector<std::string> &command,
     Sleep(1000);
     throw CPError<CPErrors::TLE>();
   }
-  return {out_buf, err_buf, (uint32_t)exit_code, cpu_secs};
+  // No RLIMIT_FSIZE on Windows: check the redirected output afterwards
+  std::error_code size_ec;
+  if (!options.stdout_file.empty() &&
+      fs::file_size(options.stdout_file, size_ec) > maxOutputBytes && !size_ec)
+    throw CPError<CPErrors::OLE>();
+  ProcessResult result{std::move(out_buf), std::move(err_buf),
+                       (uint32_t)exit_code, cpu_secs};
+  result.wall = wall_secs;
+  result.user_time = (float)(u.QuadPart * 1e-7);
+  result.sys_time = (float)(k.QuadPart * 1e-7);
+  result.bytes_read = io.ReadTransferCount;
+  result.bytes_written = io.WriteTransferCount;
+  return result;
 #else // POSIX
+  // A child that exits without reading all of its input turns our next
+  // write into SIGPIPE; keep it pending for this thread instead of letting it
+  // kill the judger.
+  SigpipeGuard sigpipe_guard;
+  PosixRun run(command, cwd, options, std::move(core));
+  while (!run.step(-1))
+    ;
+  return run.result();
+#endif
+}
 
-  int stdin_pipe[2], stdout_pipe[2], stderr_pipe[2];
-  if (pipe(stdin_pipe) < 0 || pipe(stdout_pipe) < 0 || pipe(stderr_pipe) < 0)
-    throw CPError<CPErrors::IE>("pipe creation failed");
-
-  pid_t pid = fork();
-  if (pid < 0)
-    throw CPError<CPErrors::IE>("fork failed");
-
-  if (pid == 0) {
-    // Child process
-    dup2(stdin_pipe[0], STDIN_FILENO);
-    dup2(stdout_pipe[1], STDOUT_FILENO);
-    dup2(stderr_pipe[1], STDERR_FILENO);
-
-    close(stdin_pipe[1]);
-    close(stdout_pipe[0]);
-    close(stderr_pipe[0]);
-
-    std::vector<char *> argv;
-    for (const auto &s : command)
-      argv.push_back(const_cast<char *>(s.c_str()));
-    argv.push_back(nullptr);
-
-    chdir(cwd.c_str());
-    execvp(argv[0], argv.data());
-    _exit(127);
-  }
-
-  // Parent process
-  close(stdin_pipe[0]);
-  close(stdout_pipe[1]);
-  close(stderr_pipe[1]);
-
-  // Write stdin data if provided
-  if (!stdin_data.empty())
-    write(stdin_pipe[1], stdin_data.data(), stdin_data.size());
-  close(stdin_pipe[1]);
-
-  std::string out_buf, err_buf;
-  char buf[4096];
-  bool finished = false;
-
-  while (!finished) {
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(stdout_pipe[0], &fds);
-    FD_SET(stderr_pipe[0], &fds);
-
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 10000; // 10ms timeout for select
-
-    select(std::max(stdout_pipe[0], stderr_pipe[0]) + 1, &fds, nullptr, nullptr,
-           &tv);
-
-    // Read from stdout
-    if (FD_ISSET(stdout_pipe[0], &fds)) {
-      ssize_t r = read(stdout_pipe[0], buf, sizeof(buf));
-      if (r > 0) {
-        out_buf.append(buf, (size_t)r);
-        if (out_buf.size() > maxOutputBytes) {
-          kill(pid, SIGKILL);
-          waitpid(pid, nullptr, 0); // Reap zombie
-          throw CPError<CPErrors::OLE>();
-        }
-      }
-    }
-
-    // Read from stderr
-    if (FD_ISSET(stderr_pipe[0], &fds)) {
-      ssize_t r = read(stderr_pipe[0], buf, sizeof(buf));
-      if (r > 0) {
-        err_buf.append(buf, (size_t)r);
-        if (err_buf.size() > maxOutputBytes) {
-          kill(pid, SIGKILL);
-          waitpid(pid, nullptr, 0); // Reap zombie
-          throw CPError<CPErrors::OLE>();
-        }
-      }
-    }
-
-    // Check if child has exited (non-blocking)
-    int status;
-    struct rusage usage;
-    pid_t rv = wait4(pid, &status, WNOHANG, &usage);
-
-    if (rv == pid) {
-      finished = true;
-
-      auto end_wall = std::chrono::high_resolution_clock::now();
-      float wall_secs =
-          std::chrono::duration<float>(end_wall - start_wall).count();
-
-      // CPU time from the child-specific rusage (not accumulated across calls)
-      float user_cpu_time =
-          usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
-      float system_cpu_time =
-          usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
-      float total_cpu_time = user_cpu_time + system_cpu_time;
-      float cpu_secs = total_cpu_time;
-
-      uint32_t ec = 0;
-      if (WIFEXITED(status))
-        ec = (uint32_t)WEXITSTATUS(status);
-      else if (WIFSIGNALED(status))
-        ec = 128 +
-             (uint32_t)WTERMSIG(status); // Common convention for signal exit
-
-      // Check CPU time limit after process exits
-      if (cpu_secs > time_limit_sec) {
-        throw CPError<CPErrors::TLE>();
-      }
-
-      // Debug output (optional)
-      std::cerr << "Wall: " << wall_secs << "s, CPU: " << cpu_secs << "s\n";
-
-      // Close remaining pipes
-      close(stdout_pipe[0]);
-      close(stderr_pipe[0]);
-
-      return {out_buf, err_buf, ec, cpu_secs};
+void run_command_async(const std::vector<std::string> &command,
+                       const fs::path &cwd, const RunOptions &options,
+                       RunCallback done) {
+#ifdef _WIN32
+  // No reactor here: one thread per run, blocked in run_command()
+  std::thread([=, done = std::move(done)] {
+    ProcessResult result{};
+    std::exception_ptr error;
+    try {
+      result = run_command(command, cwd, options);
+    } catch (...) {
+      error = std::current_exception();
     }
-
-    // Check wall time limit
-    auto now_wall = std::chrono::high_resolution_clock::now();
-    float elapsed = std::chrono::duration<float>(now_wall - start_wall).count();
-
-    if (elapsed > time_limit_sec) {
-      kill(pid, SIGKILL);
-      waitpid(pid, nullptr, 0); // Reap zombie
-      throw CPError<CPErrors::TLE>();
+    done(std::move(result), error);
+  }).detach();
+#else
+  auto start = [command, cwd, options,
+                done = std::move(done)](CoreAllocator::Lease core) mutable {
+    std::unique_ptr<PosixRun> run;
+    try {
+      run = std::make_unique<PosixRun>(command, cwd, options, std::move(core));
+    } catch (...) {
+      done({}, std::current_exception());
+      return;
     }
-  }
-
-  // Should never reach here
-  close(stdout_pipe[0]);
-  close(stderr_pipe[0]);
-  throw CPError<CPErrors::IE>("unexpected termination");
+    AsyncRun::start(std::move(run), std::move(done));
+  };
+  // Queued for a CPU instead of blocking the caller, which may well be the
+  // reactor thread itself
+  if (options.exclusiveCore)
+    CoreAllocator::instance().acquire_async(std::move(start));
+  else
+    start({});
 #endif
 }
+
+std::future<ProcessResult>
+run_command_future(const std::vector<std::string> &command,
+                   const fs::path &cwd, const RunOptions &options) {
+  auto promise = std::make_shared<std::promise<ProcessResult>>();
+  auto future = promise->get_future();
+  run_command_async(command, cwd, options,
+                    [promise](ProcessResult result, std::exception_ptr error) {
+                      if (error)
+                        promise->set_exception(error);
+                      else
+                        promise->set_value(std::move(result));
+                    });
+  return future;
+}
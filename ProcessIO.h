@@ -1,13 +1,20 @@
 #pragma once
+#include "Seccomp.h"
 #include <charconv>
 #include <cstdint>
+#include <exception>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <string>
 #include <string_view>
 #include <unordered_map>
 #include <vector>
 
 namespace fs = std::filesystem;
+class CgroupLeaf;
+class OutputComparator;
+
 std::string
 expand_percent_vars(std::string_view input,
                     const std::unordered_map<std::string, std::string> &vars);
@@ -16,15 +23,97 @@ struct ProcessResult {
   std::string stdout_data;
   std::string stderr_data;
   uint32_t exit_code;
-  float time;
+  float time;          // CPU seconds, user + sys
+  uint64_t memory = 0; // peak usage, KiB
+  // user-space retired instructions and cycles; only counted when
+  // RunOptions::instructionLimit is set
+  uint64_t instructions = 0;
+  uint64_t cycles = 0;
+
+  float wall = 0; // seconds from spawn to exit
+  float user_time = 0;
+  float sys_time = 0;
+  uint64_t minor_faults = 0;
+  uint64_t major_faults = 0; // pages that had to be read from disk
+  uint64_t voluntary_switches = 0; // blocked on I/O or sleep
+  uint64_t involuntary_switches = 0; // preempted
+  // bytes through read(2)/write(2) and friends, pipes and files alike
+  uint64_t bytes_read = 0;
+  uint64_t bytes_written = 0;
+  int signal = 0; // terminating signal, 0 when the program exited
+};
+struct RunOptions {
+  float time = 1.0;     // seconds
+  int maxMemory = 1024; // MiB, <= 0 for no limit
+  // pids.max of the run's cgroup, 0 for no limit; threads count too
+  int maxProcesses = 64;
+  std::size_t maxOutputBytes = (std::size_t)32 * 1024 * 1024;
+  // piped to the child's stdin when stdin_file is empty; must outlive the run
+  std::string_view stdin_data;
+  // when set, the file is attached directly as the child's fd 0 / fd 1 and
+  // never passes through the judger; stdout_data is then left empty and the
+  // output limit is enforced with RLIMIT_FSIZE (SIGXFSZ -> OLE)
+  fs::path stdin_file;
+  fs::path stdout_file;
+  // when non-zero, the run is limited by retired user-space instructions
+  // (hardware perf counters) instead of CPU time, which makes the verdict
+  // independent of machine load; `time` then only bounds wall-clock time
+  // (generously) as a safety net. Linux only: IE when counters are missing.
+  uint64_t instructionLimit = 0;
+  // hold a CoreAllocator lease for the run (waiting for a free CPU) and pin
+  // the child to that CPU
+  bool exclusiveCore = false;
+  // run inside this (already limited) leaf instead of creating one; see
+  // Sandbox. Whatever is left in it is killed when the run ends.
+  CgroupLeaf *cgroup = nullptr;
+  // ActiveSecurity: seccomp-bpf profile for the child, SIGSYS -> RF.
+  // Linux only; ignored elsewhere
+  SeccompProfile seccomp = SeccompProfile::None;
+  // when set (and stdout_file is not), stdout is streamed into it instead of
+  // stdout_data and a mismatch kills the run with WA right away. Calling
+  // finish() once the run is over is left to the caller.
+  OutputComparator *comparator = nullptr;
+  // seconds the run may go without using any CPU (deadlocked, blocked on
+  // input that never comes, sleeping) before it is stopped with ILE instead
+  // of waiting out the wall-clock limit; 0 disables the check
+  float idleTimeout = 0;
 };
 // takes input as-is, e.g. "g++ %PATH%" will run "g++ %PATH%" without the
 // expand_percent_vars
+ProcessResult run_command(const std::vector<std::string> &command,
+                          const fs::path &cwd, const RunOptions &options);
 ProcessResult run_command(const std::vector<std::string> &command,
                           const fs::path &cwd,
                           const std::string &stdin_data = "",
                           const float time = 1.0, const int maxMemory = 1024);
-enum class CPErrors { TLE, OLE, IR, IE, MLE };
+
+// memory.max of the cgroup leaf a run with `options` gets, 0 for none. With
+// stdout_file, the kernel charges that file's page cache to the program
+// writing it (all of it on a tmpfs workdir, see WorkdirPool), so the leaf
+// gets room for maxOutputBytes of it on top of maxMemory; the file's size is
+// taken off memory.peak again before the limit is checked. That keeps a
+// program printing close to the output limit from being reported as MLE.
+uint64_t run_memory_max(const RunOptions &options);
+
+// Asynchronous runs: the same run and verdicts as run_command(), but the
+// calling thread only starts it. On Linux one reactor thread supervises all
+// of them (see Reactor.h); on Windows each gets a thread of its own.
+// Everything `options` points to (stdin_data, cgroup, comparator) must stay
+// alive until the run has completed.
+//
+// `done` gets the result, or the CPError that run_command() would have
+// thrown; it runs on the reactor thread (or right away when the run cannot
+// start) and must not block it for long. With exclusiveCore, runs wait in
+// line for a CPU without holding up the caller.
+using RunCallback = std::function<void(ProcessResult, std::exception_ptr)>;
+void run_command_async(const std::vector<std::string> &command,
+                       const fs::path &cwd, const RunOptions &options,
+                       RunCallback done);
+std::future<ProcessResult>
+run_command_future(const std::vector<std::string> &command,
+                   const fs::path &cwd, const RunOptions &options);
+
+enum class CPErrors { TLE, OLE, IR, IE, MLE, RF, WA, ILE };
 
 class CPErrorBase : public std::runtime_error {
 public:
@@ -46,6 +135,12 @@ private:
       return "Invalid result";
     else if constexpr (E == CPErrors::MLE)
       return "Program exceeded memory usage";
+    else if constexpr (E == CPErrors::RF)
+      return "Restricted function (forbidden system call)";
+    else if constexpr (E == CPErrors::WA)
+      return "Wrong answer";
+    else if constexpr (E == CPErrors::ILE)
+      return "Idle limit exceeded";
     else
       return "Internal error";
   }
@@ -0,0 +1,50 @@
+#include "Reactor.h"
+#ifdef __linux__
+#include <cerrno>
+#include <pthread.h>
+#include <signal.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+
+Reactor &Reactor::instance() {
+  // Never destroyed: the thread may still be in epoll_wait() at exit
+  static Reactor *reactor = new Reactor;
+  return *reactor;
+}
+
+Reactor::Reactor() {
+  ep_ = epoll_create1(EPOLL_CLOEXEC);
+  if (ep_ < 0)
+    throw std::runtime_error("epoll_create1 failed");
+  std::thread thread([this] { loop(); });
+  thread_id_ = thread.get_id();
+  thread.detach();
+}
+
+bool Reactor::add(int fd, Source *source) {
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.ptr = source;
+  return epoll_ctl(ep_, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+void Reactor::remove(int fd) { epoll_ctl(ep_, EPOLL_CTL_DEL, fd, nullptr); }
+
+void Reactor::loop() {
+  // Writing to a child that stopped reading must give EPIPE, not kill us;
+  // the signal just stays pending for this thread
+  sigset_t pipe;
+  sigemptyset(&pipe);
+  sigaddset(&pipe, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe, nullptr);
+
+  epoll_event events[64];
+  for (;;) {
+    int n = epoll_wait(ep_, events, 64, -1);
+    // A source removes itself (and may be freed) only from its own ready(),
+    // so the pointers of one batch stay valid while it is dispatched
+    for (int i = 0; i < n; ++i)
+      static_cast<Source *>(events[i].data.ptr)->ready();
+  }
+}
+#endif
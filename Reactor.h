@@ -0,0 +1,36 @@
+#pragma once
+#ifdef __linux__
+#include <thread>
+
+// One epoll thread shared by every asynchronous run (run_command_async()).
+// A source is a pollable descriptor, typically a run's own epoll set; its
+// ready() is called on the reactor thread whenever the descriptor is
+// readable (level-triggered) and must not block.
+class Reactor {
+public:
+  class Source {
+  public:
+    virtual ~Source() = default;
+    virtual void ready() = 0;
+  };
+
+  // Started on first use and kept for the lifetime of the process
+  static Reactor &instance();
+
+  // From any thread; `source` must stay alive until remove(fd)
+  bool add(int fd, Source *source);
+  // Once removed on the reactor thread, no further ready() call is made for
+  // `fd`, so its source may be destroyed right away
+  void remove(int fd);
+  bool on_reactor_thread() const {
+    return std::this_thread::get_id() == thread_id_;
+  }
+
+private:
+  Reactor();
+  [[noreturn]] void loop();
+
+  int ep_ = -1;
+  std::thread::id thread_id_;
+};
+#endif
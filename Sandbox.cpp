@@ -0,0 +1,86 @@
+#include "Sandbox.h"
+#include <atomic>
+#include <string>
+#include <system_error>
+#include <vector>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+Sandbox::Stamp Sandbox::stamp(const fs::path &path) {
+  std::error_code ec;
+  Stamp s;
+  s.regular = fs::is_regular_file(fs::symlink_status(path, ec));
+  if (s.regular) {
+    s.size = fs::file_size(path, ec);
+    s.time = fs::last_write_time(path, ec);
+  }
+  return s;
+}
+
+Sandbox::Sandbox(fs::path workdir) : workdir_(std::move(workdir)) {
+  static std::atomic<unsigned> serial{0};
+  pristine_ = fs::temp_directory_path() /
+              ("oj-baseline-" + std::to_string(getpid()) + "-" +
+               std::to_string(serial++));
+  fs::create_directories(pristine_);
+  for (const auto &entry : fs::directory_iterator(workdir_)) {
+    fs::path name = entry.path().filename();
+    Stamp s = stamp(entry.path());
+    if (s.regular)
+      fs::copy_file(entry.path(), pristine_ / name,
+                    fs::copy_options::overwrite_existing);
+    baseline_[name] = s;
+  }
+}
+
+Sandbox::~Sandbox() {
+  // the leaf kills what is left in it
+  std::error_code ec;
+  fs::remove_all(pristine_, ec);
+}
+
+void Sandbox::reset(RunOptions &run) {
+  std::vector<fs::path> stale;
+  for (const auto &entry : fs::directory_iterator(workdir_))
+    if (!baseline_.count(entry.path().filename()))
+      stale.push_back(entry.path());
+  for (const auto &path : stale) {
+    std::error_code ec;
+    fs::remove_all(path, ec);
+  }
+  // Rewritten, truncated, replaced or deleted baseline files
+  for (auto &[name, was] : baseline_) {
+    if (!was.regular)
+      continue;
+    fs::path path = workdir_ / name;
+    Stamp now = stamp(path);
+    if (now.regular && now.size == was.size && now.time == was.time)
+      continue;
+    std::error_code ec;
+    fs::remove_all(path, ec);
+    fs::copy_file(pristine_ / name, path, ec);
+    was = stamp(path);
+  }
+
+  const uint64_t memoryBytes = run_memory_max(run);
+  const uint64_t maxPids = (uint64_t)run.maxProcesses;
+  if (cgroup_) {
+    cgroup_->kill();
+    // Before Linux 6.12 memory.peak can't be reset, so there every subtest
+    // gets a leaf of its own and only the workdir is shared
+    if (!cgroup_->reset_counters() ||
+        !cgroup_->set_limits(memoryBytes, maxPids))
+      cgroup_.reset();
+  }
+  if (!cgroup_ && cgroup_usable_) {
+    cgroup_ = CgroupLeaf::create(memoryBytes, maxPids);
+    cgroup_usable_ = cgroup_ != nullptr;
+    if (cgroup_)
+      cgroup_->reset_counters();
+  }
+  run.cgroup = cgroup_.get();
+}
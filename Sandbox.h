@@ -0,0 +1,49 @@
+#pragma once
+#include "Cgroup.h"
+#include "ProcessIO.h"
+#include <filesystem>
+#include <cstdint>
+#include <map>
+#include <memory>
+
+namespace fs = std::filesystem;
+
+// The part of a run's environment that lives as long as one submission: its
+// working directory and (on Linux) one cgroup leaf. Created right after the
+// submission is compiled; reset() between subtests only has to remove what
+// the last run left behind, restore the files it changed and zero the leaf's
+// counters, so each subtest costs little more than the exec itself.
+class Sandbox {
+public:
+  // Whatever is in `workdir` now (source, executable, compiler leftovers) is
+  // kept across resets. Its regular files are copied aside, so that one a
+  // run rewrote or truncated can be put back
+  explicit Sandbox(fs::path workdir);
+  ~Sandbox();
+
+  Sandbox(const Sandbox &) = delete;
+  Sandbox &operator=(const Sandbox &) = delete;
+
+  // Brings the sandbox back to its post-compile state, applies the limits of
+  // `run` (see run_memory_max(), so set stdout_file first) and points `run`
+  // at the shared leaf
+  void reset(RunOptions &run);
+
+  const fs::path &workdir() const { return workdir_; }
+
+private:
+  // How a baseline file looked after it was last put in place; a file whose
+  // size or modification time no longer match is copied in again
+  struct Stamp {
+    bool regular = false;
+    uintmax_t size = 0;
+    fs::file_time_type time;
+  };
+  static Stamp stamp(const fs::path &path);
+
+  fs::path workdir_;
+  fs::path pristine_; // copies of the baseline's regular files
+  std::map<fs::path, Stamp> baseline_; // by file name; survive reset()
+  std::unique_ptr<CgroupLeaf> cgroup_;
+  bool cgroup_usable_ = true; // false once creating a leaf has failed
+};
@@ -0,0 +1,228 @@
+#include "Seccomp.h"
+#include <cctype>
+#include <stdexcept>
+#include <string>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <linux/audit.h>
+#include <linux/seccomp.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+SeccompProfile parse_seccomp_profile(std::string_view name) {
+  std::string lower(name);
+  for (char &c : lower)
+    c = (char)std::tolower((unsigned char)c);
+  if (lower.empty() || lower == "none")
+    return SeccompProfile::None;
+  if (lower == "native")
+    return SeccompProfile::Native;
+  if (lower == "runtime")
+    return SeccompProfile::Runtime;
+  throw std::invalid_argument("unknown security profile: " + std::string(name));
+}
+
+SeccompProfile default_seccomp_profile(std::string_view ext) {
+  std::string lower(ext);
+  for (char &c : lower)
+    c = (char)std::tolower((unsigned char)c);
+  if (lower == ".java" || lower == ".class" || lower == ".py" ||
+      lower == ".js")
+    return SeccompProfile::Runtime;
+  return SeccompProfile::Native;
+}
+
+#ifdef __linux__
+namespace {
+#if defined(__x86_64__)
+constexpr uint32_t kArch = AUDIT_ARCH_X86_64;
+#elif defined(__aarch64__)
+constexpr uint32_t kArch = AUDIT_ARCH_AARCH64;
+#else
+constexpr uint32_t kArch = 0; // unsupported
+#endif
+
+// Memory, file I/O, time, signals and process exit: what any program needs
+// between its first instruction and exit_group(). BPF can't read the path
+// openat() is given, so files are opened with whatever access the judger's
+// user has, for writing too (file-output problems need that); keeping the
+// tests directory and other submissions out of reach is up to filesystem
+// permissions, see Seccomp.h
+const long kNative[] = {
+    SYS_read, SYS_write, SYS_readv, SYS_writev, SYS_pread64, SYS_pwrite64,
+    SYS_lseek, SYS_close, SYS_fstat, SYS_newfstatat, SYS_statx, SYS_openat,
+    SYS_faccessat, SYS_readlinkat, SYS_getcwd, SYS_fcntl, SYS_dup, SYS_dup3,
+    SYS_mmap, SYS_munmap, SYS_mremap, SYS_mprotect, SYS_brk,
+    SYS_madvise, SYS_exit, SYS_exit_group, SYS_set_tid_address,
+    SYS_set_robust_list, SYS_prlimit64, SYS_getrlimit, SYS_getrandom,
+    SYS_rt_sigaction, SYS_rt_sigprocmask, SYS_rt_sigreturn, SYS_sigaltstack,
+    SYS_clock_gettime, SYS_clock_getres, SYS_gettimeofday, SYS_nanosleep,
+    SYS_clock_nanosleep, SYS_futex, SYS_uname, SYS_getpid, SYS_gettid,
+    SYS_getuid, SYS_geteuid, SYS_getgid, SYS_getegid, SYS_getrusage,
+    SYS_times, SYS_sched_yield, SYS_sched_getaffinity, SYS_restart_syscall,
+    SYS_ppoll, SYS_fadvise64,
+#ifdef SYS_faccessat2
+    SYS_faccessat2,
+#endif
+#ifdef SYS_rseq
+    SYS_rseq,
+#endif
+#ifdef SYS_arch_prctl
+    SYS_arch_prctl,
+#endif
+#ifdef SYS_open
+    SYS_open, SYS_stat, SYS_lstat, SYS_access, SYS_readlink, SYS_dup2,
+    SYS_poll, SYS_time,
+#endif
+};
+
+// What a JVM or an interpreter adds on top: threads are allowed through
+// clone() below, these cover their bookkeeping
+const long kRuntime[] = {
+    SYS_getdents64, SYS_sysinfo, SYS_getppid, SYS_prctl, SYS_membarrier,
+    SYS_sched_getparam, SYS_sched_getscheduler, SYS_get_mempolicy,
+    SYS_pipe2, SYS_eventfd2, SYS_epoll_create1,
+    SYS_epoll_ctl, SYS_epoll_pwait, SYS_ftruncate, SYS_fsync, SYS_fdatasync,
+    SYS_flock, SYS_mkdirat, SYS_unlinkat, SYS_fchmod, SYS_get_robust_list,
+#ifdef SYS_open
+    SYS_getdents, SYS_mkdir, SYS_unlink, SYS_pipe, SYS_epoll_wait,
+#endif
+};
+
+// The ioctl() requests stdio and runtimes make: isatty(), terminal size,
+// bytes available, non-blocking and close-on-exec flags. Anything else,
+// TIOCSTI on an inherited terminal included, fails with ENOTTY
+const uint32_t kIoctls[] = {TCGETS, TIOCGWINSZ, FIONREAD,
+                            FIONBIO, FIOCLEX, FIONCLEX};
+
+sock_filter stmt(uint16_t code, uint32_t k) { return BPF_STMT(code, k); }
+sock_filter jump(uint16_t code, uint32_t k, uint8_t jt, uint8_t jf) {
+  return BPF_JUMP(code, k, jt, jf);
+}
+
+// Offsets of the low/high words of a 64-bit syscall argument (little endian)
+constexpr uint32_t arg_lo(int i) {
+  return (uint32_t)(offsetof(seccomp_data, args) + 8 * i);
+}
+constexpr uint32_t arg_hi(int i) { return arg_lo(i) + 4; }
+
+// Stands for the child's pid until bind_seccomp_self(); above any pid_max,
+// so an unbound filter matches no real process
+constexpr uint32_t kSelfPid = 0x7ffffffe;
+
+bool is_signal_nr(uint32_t nr) {
+  return nr == SYS_kill || nr == SYS_tkill || nr == SYS_tgkill;
+}
+} // namespace
+
+void bind_seccomp_self(const sock_fprog &prog, uint32_t pid) {
+  // The pid comparison is the second instruction after the syscall check;
+  // matching both keeps an execve() pointer that happens to equal kSelfPid
+  // from being rewritten
+  const uint16_t jeq = BPF_JMP | BPF_JEQ | BPF_K;
+  for (unsigned short i = 2; i < prog.len; ++i) {
+    sock_filter &f = prog.filter[i];
+    if (f.code == jeq && f.k == kSelfPid && prog.filter[i - 2].code == jeq &&
+        is_signal_nr(prog.filter[i - 2].k))
+      f.k = pid;
+  }
+}
+
+std::vector<sock_filter> build_seccomp_filter(SeccompProfile profile,
+                                              const char *exec_path) {
+  std::vector<sock_filter> f;
+  if (kArch == 0 || profile == SeccompProfile::None ||
+      __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+    return f;
+
+  const uint32_t kill = SECCOMP_RET_KILL_PROCESS;
+  const uint32_t allow = SECCOMP_RET_ALLOW;
+  auto allow_nr = [&](long nr) {
+    f.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)nr, 0, 1));
+    f.push_back(stmt(BPF_RET | BPF_K, allow));
+  };
+  auto reload_nr = [&] {
+    f.push_back(stmt(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)));
+  };
+
+  // Syscall numbers are only meaningful for our own ABI
+  f.push_back(stmt(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)));
+  f.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, kArch, 1, 0));
+  f.push_back(stmt(BPF_RET | BPF_K, kill));
+  reload_nr();
+#ifdef __x86_64__
+  // x32 syscalls share the arch value
+  f.push_back(jump(BPF_JMP | BPF_JGE | BPF_K, 0x40000000, 0, 1));
+  f.push_back(stmt(BPF_RET | BPF_K, kill));
+#endif
+
+  for (long nr : kNative)
+    allow_nr(nr);
+  if (profile == SeccompProfile::Runtime)
+    for (long nr : kRuntime)
+      allow_nr(nr);
+
+  // The kernel takes the request as an unsigned int, so its low word is all
+  // there is to compare
+  const uint8_t n = (uint8_t)std::size(kIoctls);
+  f.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, SYS_ioctl, 0, n + 3));
+  f.push_back(stmt(BPF_LD | BPF_W | BPF_ABS, arg_lo(1)));
+  for (uint8_t i = 0; i < n; ++i)
+    f.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, kIoctls[i], n - i, 0));
+  f.push_back(stmt(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOTTY));
+  f.push_back(stmt(BPF_RET | BPF_K, allow));
+
+  // abort(), raise() and failed asserts signal the program itself and must
+  // still end it with that signal; any other target fails with EPERM so the
+  // program can't signal other processes of the same user. The kernel
+  // reads the pid as an int, so its low word is all there is to compare.
+  for (long nr : {(long)SYS_kill, (long)SYS_tkill, (long)SYS_tgkill}) {
+    f.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)nr, 0, 4));
+    f.push_back(stmt(BPF_LD | BPF_W | BPF_ABS, arg_lo(0)));
+    f.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, kSelfPid, 0, 1));
+    f.push_back(stmt(BPF_RET | BPF_K, allow));
+    f.push_back(stmt(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EPERM));
+  }
+
+  // The exec that starts the program, identified by its filename pointer
+  const uint64_t path = (uint64_t)(uintptr_t)exec_path;
+  f.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, SYS_execve, 0, 6));
+  f.push_back(stmt(BPF_LD | BPF_W | BPF_ABS, arg_lo(0)));
+  f.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)path, 0, 2));
+  f.push_back(stmt(BPF_LD | BPF_W | BPF_ABS, arg_hi(0)));
+  f.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)(path >> 32), 1, 0));
+  f.push_back(stmt(BPF_RET | BPF_K, kill));
+  f.push_back(stmt(BPF_RET | BPF_K, allow));
+
+  if (profile == SeccompProfile::Runtime) {
+    reload_nr();
+    // Threads only: a clone() without CLONE_THREAD would be a new process
+    f.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, SYS_clone, 0, 3));
+    f.push_back(stmt(BPF_LD | BPF_W | BPF_ABS, arg_lo(0)));
+    f.push_back(jump(BPF_JMP | BPF_JSET | BPF_K, CLONE_THREAD, 0, 1));
+    f.push_back(stmt(BPF_RET | BPF_K, allow));
+    reload_nr();
+#ifdef SYS_clone3
+    // clone3() passes its flags in memory BPF can't read; glibc falls back
+    // to clone() on ENOSYS
+    f.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, SYS_clone3, 0, 1));
+    f.push_back(stmt(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOSYS));
+#endif
+  }
+#ifdef SYS_clone3
+  else {
+    // Same fallback for single-threaded programs whose libc probes clone3
+    f.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, SYS_clone3, 0, 1));
+    f.push_back(stmt(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOSYS));
+  }
+#endif
+  f.push_back(stmt(BPF_RET | BPF_K, kill));
+  return f;
+}
+#endif
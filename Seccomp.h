@@ -0,0 +1,43 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
+
+// System call profiles for ActiveSecurity. The filter is installed in the
+// child right before execve() and runs in the kernel (JIT-compiled BPF), so
+// unlike a ptrace sandbox it adds no measurable cost to allowed syscalls.
+// Anything outside the profile kills the run with SIGSYS.
+//
+// The filter limits what a program can do, not which files it can do it
+// to: open() and openat() are allowed for any path and mode, since BPF
+// can't read the path and file-output problems write into the workdir.
+// Run the judger as a user that can't write the tests directory or other
+// contestants' folders when that matters.
+enum class SeccompProfile {
+  None,
+  Native,  // single-threaded compiled programs, static or dynamically linked
+  Runtime, // managed runtimes (JVM, interpreters): Native plus threads and
+           // the extra housekeeping calls they make at startup
+};
+
+// "none", "native" or "runtime", case-insensitive; throws
+// std::invalid_argument otherwise
+SeccompProfile parse_seccomp_profile(std::string_view name);
+// Profile for a source file extension such as ".cpp" or ".java"
+SeccompProfile default_seccomp_profile(std::string_view ext);
+
+#ifdef __linux__
+// BPF program for `profile`. execve() is only allowed with `exec_path` as its
+// filename pointer, i.e. for the one exec that starts the program; the new
+// image can't reproduce a pointer into the old address space. Empty when
+// seccomp is not supported on this architecture.
+std::vector<sock_filter> build_seccomp_filter(SeccompProfile profile,
+                                              const char *exec_path);
+// kill(), tkill() and tgkill() are only allowed on the program itself, whose
+// pid isn't known while the filter is built; the child fills it in before
+// installing the filter. Only writes into prog.filter, so it is safe in a
+// CLONE_VM child.
+void bind_seccomp_self(const sock_fprog &prog, uint32_t pid);
+#endif
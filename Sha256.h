@@ -0,0 +1,25 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// FIPS 180-4 SHA-256, for content-addressed caches
+class Sha256 {
+public:
+  Sha256();
+  void update(const void *data, std::size_t size);
+  void update(std::string_view data) { update(data.data(), data.size()); }
+  // Finishes the hash; the object must not be updated afterwards
+  std::array<uint8_t, 32> digest();
+  std::string hex_digest();
+
+private:
+  void block(const uint8_t *p);
+
+  uint32_t state_[8];
+  uint8_t buffer_[64];
+  std::size_t buffered_ = 0;
+  uint64_t length_ = 0; // bytes
+};
@@ -0,0 +1,241 @@
+#include "Spawn.h"
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <linux/seccomp.h>
+#include <memory>
+#include <sched.h>
+#include <signal.h>
+#include <sstream>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+  (void)pid;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int signal_pidfd(int pidfd, int sig) {
+#ifdef SYS_pidfd_send_signal
+  return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0);
+#else
+  (void)pidfd;
+  (void)sig;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+bool reap_child(pid_t pid, int flags, int &status, rusage &usage,
+                IoCounters &io) {
+  // Peek first: /proc/<pid>/io stays readable until the zombie is reaped
+  siginfo_t info{};
+  int r;
+  do
+    r = waitid(P_PID, (id_t)pid, &info, WEXITED | WNOWAIT | flags);
+  while (r < 0 && errno == EINTR);
+  if (r < 0 || info.si_pid != pid)
+    return false;
+
+  std::ifstream f("/proc/" + std::to_string(pid) + "/io");
+  std::string key;
+  uint64_t value;
+  while (f >> key >> value) {
+    if (key == "rchar:")
+      io.read = value;
+    else if (key == "wchar:")
+      io.written = value;
+  }
+  return wait4(pid, &status, 0, &usage) == pid;
+}
+
+std::string resolve_executable(const std::string &name) {
+  if (name.empty() || name.find('/') != std::string::npos)
+    return name;
+  const char *path = getenv("PATH");
+  std::istringstream dirs(path ? path : "/usr/local/bin:/usr/bin:/bin");
+  std::string dir;
+  while (std::getline(dirs, dir, ':')) {
+    std::string candidate = (dir.empty() ? "." : dir) + "/" + name;
+    if (access(candidate.c_str(), X_OK) == 0)
+      return candidate;
+  }
+  return name; // let execve() report ENOENT
+}
+
+ssize_t send_fds(int sock, const void *buf, size_t len, const int *fds,
+                 int nfds) {
+  iovec iov{const_cast<void *>(buf), len};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxPassedFds)];
+  if (nfds > 0) {
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+    cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+    std::memcpy(CMSG_DATA(cm), fds, sizeof(int) * nfds);
+  }
+  ssize_t r;
+  do
+    r = sendmsg(sock, &msg, MSG_NOSIGNAL);
+  while (r < 0 && errno == EINTR);
+  return r;
+}
+
+ssize_t recv_fds(int sock, void *buf, size_t len, int *fds, int &nfds) {
+  iovec iov{buf, len};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxPassedFds)];
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t r;
+  do
+    r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  while (r < 0 && errno == EINTR);
+  nfds = 0;
+  if (r < 0)
+    return r;
+  for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+    if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+      continue;
+    int n = (int)((cm->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+    std::memcpy(fds + nfds, CMSG_DATA(cm), sizeof(int) * n);
+    nfds += n;
+  }
+  return r;
+}
+
+namespace {
+// Counters on the calling process that start at execve() and follow its
+// threads and children. Our copies are O_CLOEXEC; the judger's copies keep
+// the events alive after exec.
+void send_counters(int sock) {
+  const uint64_t configs[] = {PERF_COUNT_HW_INSTRUCTIONS,
+                              PERF_COUNT_HW_CPU_CYCLES};
+  int fds[2], n = 0;
+  for (uint64_t config : configs) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+                          PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0)
+      break;
+    fds[n++] = fd;
+  }
+  char count = (char)n;
+  send_fds(sock, &count, 1, fds, n);
+}
+} // namespace
+
+void exec_child(const ChildSetup &setup) {
+  // dup2 clears O_CLOEXEC on the standard descriptors
+  if (setup.stdin_fd >= 0)
+    dup2(setup.stdin_fd, STDIN_FILENO);
+  if (setup.stdout_fd >= 0)
+    dup2(setup.stdout_fd, STDOUT_FILENO);
+  if (setup.stderr_fd >= 0)
+    dup2(setup.stderr_fd, STDERR_FILENO);
+
+  if (setup.fsize != RLIM_INFINITY) {
+    rlimit fsize{setup.fsize, setup.fsize};
+    setrlimit(RLIMIT_FSIZE, &fsize);
+  }
+  if (setup.as != RLIM_INFINITY) {
+    rlimit as{setup.as, setup.as};
+    setrlimit(RLIMIT_AS, &as);
+  }
+  if (setup.cgroup_procs_fd >= 0 && write(setup.cgroup_procs_fd, "0", 1) != 1)
+    _exit(127);
+
+  if (setup.cwd && chdir(setup.cwd) < 0)
+    _exit(127);
+  if (setup.cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(setup.cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+      _exit(127);
+  }
+  if (setup.perf_sock >= 0)
+    send_counters(setup.perf_sock);
+  // Whatever the spawning thread had blocked (SIGPIPE while it drives runs)
+  // must not leak into the program: it gets an empty mask, like a shell
+  // would give it
+  sigset_t none;
+  sigemptyset(&none);
+  sigprocmask(SIG_SETMASK, &none, nullptr);
+  if (setup.seccomp)
+    bind_seccomp_self(*setup.seccomp, (uint32_t)getpid());
+  if (setup.seccomp &&
+      (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0 ||
+       prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, setup.seccomp) < 0))
+    _exit(127);
+  execve(setup.path, setup.argv, setup.envp ? setup.envp : environ);
+  _exit(127);
+}
+
+namespace {
+int clone_entry(void *p) {
+  // We share the parent's memory: a judger signal handler must never run
+  // here, so put every caught signal back to its default. Everything stays
+  // blocked until exec_child() clears the mask just before it execs.
+  for (int sig = 1; sig < NSIG; ++sig) {
+    struct sigaction sa;
+    if (sigaction(sig, nullptr, &sa) == 0 && sa.sa_handler != SIG_IGN &&
+        sa.sa_handler != SIG_DFL) {
+      sa.sa_handler = SIG_DFL;
+      sa.sa_flags = 0;
+      sigaction(sig, &sa, nullptr);
+    }
+  }
+  exec_child(*static_cast<const ChildSetup *>(p));
+}
+} // namespace
+
+pid_t spawn_child(const ChildSetup &setup) {
+  // exec_child() only needs a few hundred bytes of stack
+  constexpr size_t kStackSize = 64 * 1024;
+  auto stack = std::make_unique<char[]>(kStackSize);
+
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+
+  pid_t pid = clone(clone_entry, stack.get() + kStackSize,
+                    CLONE_VM | CLONE_VFORK | SIGCHLD,
+                    const_cast<ChildSetup *>(&setup));
+  int saved = errno;
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+  errno = saved;
+  return pid;
+}
+#endif
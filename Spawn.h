@@ -0,0 +1,65 @@
+#pragma once
+#ifndef _WIN32
+#include "Seccomp.h"
+#include <cstdint>
+#include <string>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+// Everything a child does between clone() and execve(). The parent prepares
+// it completely; the child only issues syscalls on it (no allocation, no
+// locks), which is what makes CLONE_VM|CLONE_VFORK safe while other judger
+// threads keep running.
+struct ChildSetup {
+  int stdin_fd = -1, stdout_fd = -1, stderr_fd = -1;
+  const char *cwd = nullptr;
+  const char *path = nullptr; // from resolve_executable()
+  char *const *argv = nullptr;
+  char *const *envp = nullptr;   // environ when null
+  rlim_t fsize = RLIM_INFINITY;  // RLIMIT_FSIZE
+  rlim_t as = RLIM_INFINITY;     // RLIMIT_AS
+  int cgroup_procs_fd = -1;      // joined with write(fd, "0") when >= 0
+  int cpu = -1;                  // pinned with sched_setaffinity() when >= 0
+  // when >= 0: open user-space instruction and cycle counters on the child
+  // (enable_on_exec, inherited) and send them here before exec
+  int perf_sock = -1;
+  // installed together with no_new_privs as the very last step before
+  // execve(); built by build_seccomp_filter() for `path`
+  const sock_fprog *seccomp = nullptr;
+};
+
+// SCM_RIGHTS helpers; recv_fds() needs room for kMaxPassedFds descriptors
+constexpr int kMaxPassedFds = 8;
+ssize_t send_fds(int sock, const void *buf, size_t len, const int *fds,
+                 int nfds);
+ssize_t recv_fds(int sock, void *buf, size_t len, int *fds, int &nfds);
+
+// pidfd_open(2)/pidfd_send_signal(2); -1 with ENOSYS before Linux 5.3/5.1
+int open_pidfd(pid_t pid);
+int signal_pidfd(int pidfd, int sig);
+
+// rchar/wchar of /proc/<pid>/io: bytes moved through read(2)/write(2) and
+// friends by the process and every descendant it reaped
+struct IoCounters {
+  uint64_t read = 0;
+  uint64_t written = 0;
+};
+
+// wait4() that also collects the I/O counters, which vanish together with
+// the zombie; false while the child still runs (WNOHANG) or on error
+bool reap_child(pid_t pid, int flags, int &status, rusage &usage,
+                IoCounters &io);
+
+// PATH lookup as execvp() does it, done in the parent so that the child
+// never has to allocate
+std::string resolve_executable(const std::string &name);
+
+// Applies `setup` to the calling process and execs; _exit(127) on failure.
+// Only issues syscalls, so it is safe in a CLONE_VM child.
+[[noreturn]] void exec_child(const ChildSetup &setup);
+
+// Starts exec_child(setup) with clone(CLONE_VM | CLONE_VFORK): no page tables
+// are copied, so the cost stays flat however large the judger's heap grows.
+// Returns once the child has exec'd or died; -1 with errno on failure.
+pid_t spawn_child(const ChildSetup &setup);
+#endif
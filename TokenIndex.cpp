@@ -0,0 +1,258 @@
+#include "TokenIndex.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <system_error>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr std::string_view kBom = "\xEF\xBB\xBF";
+constexpr uint32_t kMagic = 0x3178746f; // "otx1"
+constexpr uint64_t kFnvOffset = 0xcbf29ce484222325ull;
+constexpr uint64_t kFnvPrime = 0x100000001b3ull;
+
+struct IndexHeader {
+  uint32_t magic;
+  uint32_t policy;
+  uint64_t block;
+  uint64_t sourceSize; // of the expected output the index was built from
+  int64_t sourceTime;  // its last_write_time()
+  uint64_t length;
+  uint64_t blocks;
+};
+
+long process_id() {
+#ifdef _WIN32
+  return _getpid();
+#else
+  return getpid();
+#endif
+}
+
+bool source_stamp(const fs::path &expected, uint64_t &size, int64_t &time) {
+  std::error_code ec;
+  size = fs::file_size(expected, ec);
+  if (ec)
+    return false;
+  auto stamp = fs::last_write_time(expected, ec);
+  time = (int64_t)stamp.time_since_epoch().count();
+  return !ec;
+}
+
+bool indexable(BuiltinChecker policy) {
+  return policy == BuiltinChecker::Tokens ||
+         policy == BuiltinChecker::LinesWords;
+}
+
+fs::path &index_root() {
+  static fs::path root;
+  return root;
+}
+} // namespace
+
+void CanonicalHasher::feed(std::string_view chunk) {
+  if (policy_ == BuiltinChecker::Tokens && !head_done_) {
+    // Hold the first bytes back until we know whether they are a BOM
+    std::size_t take = std::min(chunk.size(), kBom.size() - head_.size());
+    head_.append(chunk.substr(0, take));
+    chunk.remove_prefix(take);
+    if (head_.size() < kBom.size() && kBom.starts_with(head_))
+      return;
+    head_done_ = true;
+    if (head_ != kBom)
+      for (unsigned char c : head_)
+        byte(c);
+  }
+  for (unsigned char c : chunk)
+    byte(c);
+}
+
+void CanonicalHasher::finish() {
+  if (policy_ == BuiltinChecker::Tokens) {
+    if (!head_done_) {
+      head_done_ = true;
+      if (head_ != kBom)
+        for (unsigned char c : head_)
+          byte(c);
+    }
+    if (in_token_)
+      emit(' ');
+  }
+  in_token_ = false;
+  if (in_block_) {
+    blocks_.push_back(hash_);
+    in_block_ = 0;
+  }
+}
+
+void CanonicalHasher::byte(unsigned char c) {
+  bool space = std::isspace(c) != 0;
+  if (policy_ == BuiltinChecker::Tokens) {
+    if (space) {
+      if (in_token_)
+        emit(' ');
+      in_token_ = false;
+      return;
+    }
+    if (!in_token_) {
+      in_token_ = true;
+      token_len_ = 0;
+    }
+    if (token_len_++ < TokenComparator::kMaxToken)
+      emit((unsigned char)std::tolower(c));
+    return;
+  }
+
+  if (c == '\n') {
+    in_token_ = false;
+    line_tokens_ = 0;
+    ++pending_newlines_;
+    return;
+  }
+  if (space) {
+    in_token_ = false;
+    return;
+  }
+  if (!in_token_) {
+    for (; pending_newlines_; --pending_newlines_)
+      emit('\n');
+    if (line_tokens_++)
+      emit(' ');
+    in_token_ = true;
+  }
+  emit(c);
+}
+
+void CanonicalHasher::emit(unsigned char c) {
+  if (!in_block_)
+    hash_ = kFnvOffset;
+  hash_ = (hash_ ^ c) * kFnvPrime;
+  ++length_;
+  if (++in_block_ == kBlock) {
+    blocks_.push_back(hash_);
+    in_block_ = 0;
+  }
+}
+
+void TokenIndex::configure(fs::path root) {
+  index_root() = std::move(root);
+  std::error_code ec;
+  if (!index_root().empty())
+    fs::create_directories(index_root(), ec);
+}
+
+bool TokenIndex::enabled() { return !index_root().empty(); }
+
+fs::path TokenIndex::path_for(const fs::path &expected,
+                              BuiltinChecker policy) {
+  Sha256 name;
+  name.update(fs::absolute(expected).lexically_normal().string());
+  return index_root() / (name.hex_digest() + (policy == BuiltinChecker::Tokens
+                                                  ? ".c1idx"
+                                                  : ".c2idx"));
+}
+
+bool TokenIndex::prepare(const fs::path &expected, BuiltinChecker policy) {
+  if (!enabled() || !indexable(policy))
+    return false;
+  if (load(expected, policy))
+    return true;
+
+  IndexHeader header{};
+  header.magic = kMagic;
+  header.policy = (uint32_t)policy;
+  header.block = CanonicalHasher::kBlock;
+  if (!source_stamp(expected, header.sourceSize, header.sourceTime))
+    return false;
+  CanonicalHasher hasher(policy);
+  try {
+    MappedFile file(expected);
+    hasher.feed(file.view());
+  } catch (const std::exception &) {
+    return false;
+  }
+  hasher.finish();
+  header.length = hasher.length();
+  header.blocks = hasher.blocks().size();
+
+  // Written aside and renamed into place, so readers never see half of it
+  fs::path path = path_for(expected, policy);
+  fs::path tmp = path;
+  tmp += ".tmp-" + std::to_string(process_id());
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(hasher.blocks().data()),
+              hasher.blocks().size() * sizeof(uint64_t));
+    if (!out.flush()) {
+      std::error_code ec;
+      fs::remove(tmp, ec);
+      return false;
+    }
+  }
+  std::error_code ec;
+  fs::rename(tmp, path, ec);
+  if (ec)
+    fs::remove(tmp, ec);
+  return !ec;
+}
+
+std::optional<TokenIndex> TokenIndex::load(const fs::path &expected,
+                                           BuiltinChecker policy) {
+  if (!enabled() || !indexable(policy))
+    return std::nullopt;
+  std::ifstream in(path_for(expected, policy), std::ios::binary);
+  IndexHeader header;
+  if (!in || !in.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    return std::nullopt;
+
+  // A canonical form is never longer than its output plus one space, which
+  // also bounds what a damaged header can make us allocate
+  uint64_t size;
+  int64_t time;
+  if (!source_stamp(expected, size, time) || header.magic != kMagic ||
+      header.policy != (uint32_t)policy ||
+      header.block != CanonicalHasher::kBlock || header.sourceSize != size ||
+      header.sourceTime != time || header.length > size + 1 ||
+      header.blocks != (header.length + header.block - 1) / header.block)
+    return std::nullopt;
+
+  TokenIndex index;
+  index.policy = policy;
+  index.length = header.length;
+  index.blocks.resize(header.blocks);
+  if (!in.read(reinterpret_cast<char *>(index.blocks.data()),
+               index.blocks.size() * sizeof(uint64_t)))
+    return std::nullopt;
+  return index;
+}
+
+bool DigestComparator::feed(std::string_view chunk) {
+  if (failed_)
+    return false;
+  hasher_.feed(chunk);
+  return check();
+}
+
+bool DigestComparator::finish() {
+  if (failed_)
+    return false;
+  hasher_.finish();
+  return check() && matched_ == index_.blocks.size() &&
+         hasher_.length() == index_.length;
+}
+
+bool DigestComparator::check() {
+  if (hasher_.length() > index_.length)
+    return !(failed_ = true);
+  for (uint64_t hash : hasher_.blocks())
+    if (matched_ == index_.blocks.size() || index_.blocks[matched_++] != hash)
+      return !(failed_ = true);
+  hasher_.blocks().clear();
+  return true;
+}
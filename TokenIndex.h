@@ -0,0 +1,101 @@
+#pragma once
+#include "Comparators.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// The canonical form of an output under a comparison policy, hashed in
+// fixed-size blocks as it is produced:
+//   Tokens     - every token, case-folded and cut at kMaxToken bytes, then
+//                a space; a leading BOM dropped
+//   LinesWords - the tokens of each line joined by one space, lines joined
+//                by '\n', trailing empty lines dropped
+// Two outputs pass the built-in check exactly when their forms are equal.
+class CanonicalHasher {
+public:
+  static constexpr std::size_t kBlock = 64 * 1024;
+
+  explicit CanonicalHasher(BuiltinChecker policy) : policy_(policy) {}
+  void feed(std::string_view chunk);
+  // End of output; flushes the last, partial block
+  void finish();
+
+  // Hashes of the blocks completed so far; the caller may drain it
+  std::vector<uint64_t> &blocks() { return blocks_; }
+  // Bytes of canonical form produced so far
+  uint64_t length() const { return length_; }
+
+private:
+  void byte(unsigned char c);
+  void emit(unsigned char c);
+
+  BuiltinChecker policy_;
+  uint64_t hash_ = 0;
+  std::size_t in_block_ = 0;
+  uint64_t length_ = 0;
+  std::vector<uint64_t> blocks_;
+  bool in_token_ = false;
+  std::size_t token_len_ = 0;
+  std::size_t line_tokens_ = 0;      // LinesWords: tokens on the line so far
+  std::size_t pending_newlines_ = 0; // LinesWords: held until a token follows
+  std::string head_;                 // Tokens: first bytes, until the BOM is
+  bool head_done_ = false;           // decided
+};
+
+// Sidecar of an expected output with the block hashes of its canonical
+// form, so that checking an output reads a few KiB instead of the whole
+// answer. Sidecars live in the judger's cache directory, named after the
+// answer's path (<sha256>.c1idx, <sha256>.c2idx), so the tests directory is
+// only ever read. Rebuilt when the answer's size or modification time
+// changes.
+class TokenIndex {
+public:
+  // Sidecars are kept below `root`; an empty root disables them. Call
+  // before the first prepare() or load()
+  static void configure(fs::path root);
+  static bool enabled();
+
+  static fs::path path_for(const fs::path &expected, BuiltinChecker policy);
+  // Writes the sidecar of `expected` unless an up-to-date one exists; false
+  // when it can't be (disabled, unwritable cache, unreadable answer)
+  static bool prepare(const fs::path &expected, BuiltinChecker policy);
+  // The up-to-date sidecar of `expected`, if there is one
+  static std::optional<TokenIndex> load(const fs::path &expected,
+                                        BuiltinChecker policy);
+
+  BuiltinChecker policy = BuiltinChecker::Tokens;
+  uint64_t length = 0;          // bytes of canonical form
+  std::vector<uint64_t> blocks; // one per CanonicalHasher::kBlock
+};
+
+// Checks an output against a TokenIndex in a single pass. Mismatches are
+// noticed a block at a time.
+//
+// The check is probabilistic: blocks are compared by their 64-bit FNV-1a
+// hash only, so a wrong output passes if every block that differs collides,
+// about 2^-64 per block for output not built to collide. FNV-1a is not
+// collision resistant, but crafting a collision needs the answer, and with
+// the answer in hand one may as well print it. Leave TokenIndex off for
+// byte-exact built-in checks.
+class DigestComparator : public OutputComparator {
+public:
+  explicit DigestComparator(TokenIndex index)
+      : index_(std::move(index)), hasher_(index_.policy) {}
+
+  bool feed(std::string_view chunk) override;
+  bool finish() override;
+
+private:
+  bool check();
+
+  TokenIndex index_;
+  CanonicalHasher hasher_;
+  std::size_t matched_ = 0; // blocks
+  bool failed_ = false;
+};
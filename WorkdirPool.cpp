@@ -0,0 +1,190 @@
+#include "WorkdirPool.h"
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <sys/mount.h>
+#endif
+
+namespace {
+long process_id() {
+#ifdef _WIN32
+  return _getpid();
+#else
+  return getpid();
+#endif
+}
+
+// Removes what is inside `dir`, keeping `dir` itself
+bool clear_directory(const fs::path &dir) {
+  std::error_code ec;
+  for (const auto &entry : fs::directory_iterator(dir, ec)) {
+    fs::remove_all(entry.path(), ec);
+    if (ec)
+      return false;
+  }
+  return !ec;
+}
+
+#ifdef __linux__
+constexpr const char *kSource = "oj-workdir"; // names our tmpfs mounts
+
+// /proc/self/mountinfo escapes blanks and backslashes as \ooo
+std::string unescape_mountinfo(const std::string &s) {
+  std::string out;
+  for (std::size_t i = 0; i < s.size(); ++i)
+    if (s[i] == '\\' && i + 3 < s.size()) {
+      out += (char)std::stoi(s.substr(i + 1, 3), nullptr, 8);
+      i += 3;
+    } else {
+      out += s[i];
+    }
+  return out;
+}
+
+// Our tmpfs workdirs below `root` whose judger is gone. Directories are
+// named <pid>-<n>; a live pid other than ours is another judger's
+std::vector<fs::path> stale_mounts(const fs::path &root) {
+  std::vector<fs::path> stale;
+  std::ifstream in("/proc/self/mountinfo");
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string field, point;
+    for (int i = 0; i < 5 && fields >> field; ++i)
+      point = field; // the fifth field is the mount point
+    while (fields >> field && field != "-")
+      ;
+    std::string type, source;
+    if (!(fields >> type >> source) || type != "tmpfs" || source != kSource)
+      continue;
+    fs::path path = unescape_mountinfo(point);
+    if (path.parent_path() != root)
+      continue;
+    long pid = std::atol(path.filename().c_str());
+    if (pid <= 0 || pid == process_id() ||
+        (kill((pid_t)pid, 0) < 0 && errno == ESRCH))
+      stale.push_back(path);
+  }
+  return stale;
+}
+#endif
+} // namespace
+
+WorkdirPool &WorkdirPool::instance() {
+  static WorkdirPool pool;
+  return pool;
+}
+
+WorkdirPool::~WorkdirPool() {
+  std::error_code ec;
+  for (auto &slot : slots_) {
+#ifdef __linux__
+    if (slot.mounted)
+      umount2(slot.dir.c_str(), MNT_DETACH);
+#endif
+    fs::remove_all(slot.dir, ec);
+  }
+}
+
+void WorkdirPool::configure(fs::path root, uint64_t quota) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  root_ = std::move(root);
+  quota_ = quota;
+#ifdef __linux__
+  std::error_code ec;
+  fs::create_directories(root_, ec);
+  root_ = fs::absolute(root_, ec).lexically_normal();
+  for (const auto &dir : stale_mounts(root_)) {
+    umount2(dir.c_str(), MNT_DETACH);
+    fs::remove_all(dir, ec);
+  }
+  mounted_ = false;
+  if (quota_ > 0) {
+    // Find out now whether mounting works, rather than on the first lease
+    Slot probe;
+    probe.dir = root_ / (std::to_string(process_id()) + "-probe");
+    fs::create_directories(probe.dir, ec);
+    mounted_ = !ec && mount_slot(probe);
+    if (mounted_)
+      umount2(probe.dir.c_str(), MNT_DETACH);
+    fs::remove_all(probe.dir, ec);
+  }
+#endif
+}
+
+bool WorkdirPool::mount_slot(Slot &slot) {
+#ifdef __linux__
+  // Not noexec: the compiled program runs from here
+  std::string options = "size=" + std::to_string(quota_) + ",mode=0755";
+  slot.mounted = mount("oj-workdir", slot.dir.c_str(), "tmpfs",
+                       MS_NOSUID | MS_NODEV, options.c_str()) == 0;
+#endif
+  return slot.mounted;
+}
+
+WorkdirPool::Lease WorkdirPool::acquire() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (free_.empty()) {
+    Slot slot;
+    slot.dir = root_ / (std::to_string(process_id()) + "-" +
+                        std::to_string(slots_.size()));
+    std::error_code ec;
+    fs::create_directories(slot.dir, ec);
+    if (ec)
+      throw std::runtime_error("cannot create " + slot.dir.string() + ": " +
+                               ec.message());
+    // Without the privilege to mount, fall back to plain directories
+    if (mounted_ && !mount_slot(slot))
+      mounted_ = false;
+    // A stale directory of an earlier judger that had the same pid
+    if (!slot.mounted)
+      clear_directory(slot.dir);
+    slots_.push_back(std::move(slot));
+    free_.push_back(slots_.size() - 1);
+  }
+  std::size_t index = free_.back();
+  free_.pop_back();
+  return Lease(this, index, slots_[index].dir);
+}
+
+void WorkdirPool::release(std::size_t index) {
+  // The slot is neither free nor leased while it is wiped, so the wipe runs
+  // unlocked and other submissions' acquire() calls don't queue behind it.
+  // slots_ may grow meanwhile: work on a copy.
+  Slot slot;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slot = slots_[index];
+  }
+  bool clean;
+#ifdef __linux__
+  if (slot.mounted) {
+    // A fresh tmpfs drops everything at once, however many files there are
+    clean = umount2(slot.dir.c_str(), MNT_DETACH) == 0 && mount_slot(slot);
+  } else
+#endif
+    clean = clear_directory(slot.dir);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  slots_[index].mounted = slot.mounted;
+  // A directory that couldn't be cleaned is not handed out again
+  if (clean)
+    free_.push_back(index);
+}
+
+WorkdirPool::Lease::~Lease() {
+  if (owner_)
+    owner_->release(slot_);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Working directories for submissions, handed out one per judged submission
+// and wiped when returned, so judgeWORK no longer grows for the whole
+// contest. On Linux, when the judger may mount (CAP_SYS_ADMIN), each
+// directory is its own tmpfs of `quota` bytes: nothing touches the disk, a
+// flood of output stops at ENOSPC, and a reset is a remount. Elsewhere the
+// directories are plain ones and a reset unlinks their contents.
+class WorkdirPool {
+public:
+  // Owns one directory until destroyed
+  class Lease {
+  public:
+    Lease(Lease &&other) noexcept
+        : owner_(other.owner_), slot_(other.slot_), path_(other.path_) {
+      other.owner_ = nullptr;
+    }
+    Lease &operator=(Lease &&) = delete;
+    ~Lease();
+    const fs::path &path() const { return path_; }
+
+  private:
+    friend class WorkdirPool;
+    Lease(WorkdirPool *owner, std::size_t slot, fs::path path)
+        : owner_(owner), slot_(slot), path_(std::move(path)) {}
+    WorkdirPool *owner_;
+    std::size_t slot_;
+    fs::path path_;
+  };
+
+  static WorkdirPool &instance();
+  ~WorkdirPool(); // unmounts and removes every directory
+
+  // Directories are created below `root`; quota 0 keeps plain directories.
+  // Unmounts the tmpfs workdirs a crashed judger left below `root`, and
+  // tries a mount right away: check mounted() afterwards, the quota has no
+  // effect without one. Call before the first acquire().
+  void configure(fs::path root, uint64_t quota);
+  // A clean directory; throws std::runtime_error when none can be made
+  Lease acquire();
+  // true when directories are size-limited tmpfs mounts
+  bool mounted() const { return mounted_; }
+
+private:
+  struct Slot {
+    fs::path dir;
+    bool mounted = false;
+  };
+
+  bool mount_slot(Slot &slot);
+  void release(std::size_t slot);
+
+  std::mutex mutex_;
+  fs::path root_ = "judgeWORK";
+  uint64_t quota_ = 0;
+  bool mounted_ = false;
+  std::vector<Slot> slots_;
+  std::vector<std::size_t> free_;
+};
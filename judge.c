@@ -20,6 +20,7 @@
 //
 // (or just pick it from CMake)
 
+#include "JudgeV2.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -325,6 +326,87 @@ double API_CALL Judge(str *contestantsDir, str *testsDir, str *testOutputs,
   return score;
 }
 
+// ------------------------------------------------------------
+// ABI v2 (JudgeV2.h): the same comparison on the mapped answer and
+// output, for a single output file. Bytes, UTF-8 on every platform
+// ------------------------------------------------------------
+typedef struct {
+  const char *p, *end;
+} cursor;
+
+static int next_line(cursor *c, cursor *line) {
+  if (c->p >= c->end)
+    return 0;
+  const char *nl = memchr(c->p, '\n', (size_t)(c->end - c->p));
+  line->p = c->p;
+  line->end = nl ? nl : c->end;
+  c->p = nl ? nl + 1 : c->end;
+  return 1;
+}
+
+static int next_word(cursor *line, cursor *word) {
+  while (line->p < line->end && isspace((unsigned char)*line->p))
+    ++line->p;
+  if (line->p == line->end)
+    return 0;
+  word->p = line->p;
+  while (line->p < line->end && !isspace((unsigned char)*line->p))
+    ++line->p;
+  word->end = line->p;
+  return 1;
+}
+
+static int compare_spans(JudgeSpan exp, JudgeSpan act) {
+  cursor a = {exp.data, exp.data + exp.size};
+  cursor b = {act.data, act.data + act.size};
+  cursor la, lb, wa, wb;
+
+  for (;;) {
+    int ra = next_line(&a, &la);
+    int rb = next_line(&b, &lb);
+
+    if (!ra && !rb)
+      return 1;
+    if (!ra || !rb)
+      return 0;
+
+    for (;;) {
+      int ha = next_word(&la, &wa);
+      int hb = next_word(&lb, &wb);
+
+      if (!ha && !hb)
+        break;
+      if (!ha || !hb || wa.end - wa.p != wb.end - wb.p)
+        return 0;
+      for (; wa.p < wa.end; ++wa.p, ++wb.p)
+        if (tolower((unsigned char)*wa.p) != tolower((unsigned char)*wb.p))
+          return 0;
+    }
+  }
+}
+
+DLL_EXPORT
+double JudgeV2(const JudgeRequestV2 *request) {
+  if (!request || request->version < 2)
+    return 0.0;
+
+  // "<name>: PASSED" like Judge() writes for each file
+  int cmp = compare_spans(request->expected, request->output);
+  const char *name = request->testName ? request->testName : "";
+  const char *text = cmp ? ": PASSED\n" : ": FAILED\n";
+  request->comment(request->context, name, strlen(name));
+  request->comment(request->context, text, strlen(text));
+  return cmp ? 1.0 : 0.0;
+}
+
+// Every subtest of a submission at once; nothing to share in this one
+DLL_EXPORT
+void JudgeBatchV2(const JudgeRequestV2 *requests, size_t count,
+                  double *scores) {
+  for (size_t i = 0; i < count; ++i)
+    scores[i] = JudgeV2(&requests[i]);
+}
+
 #ifdef __cplusplus
 }
 #endif
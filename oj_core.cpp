@@ -7,6 +7,8 @@
 #include <cpptrace/cpptrace.hpp>
 #include <cpptrace/exceptions.hpp>
 #include <cpptrace/from_current_macros.hpp>
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <functional>
 #include <iostream>
@@ -18,18 +20,32 @@
 #include <plog/Log.h>
 #include <signal.h>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 #include <zlib.h>
 std::function<void()> fn;
 #include "Base.h"
+#include "BoundedQueue.h"
+#include "Cgroup.h"
+#include "CheckerHost.h"
+#include "Comparators.h"
+#include "CompileCache.h"
+#include "CoreAllocator.h"
+#include "JudgeAPI.h"
 #include "JudgeBackend.h"
+#include "OrderedAppender.h"
 #include "Parsers.h"
 #include "SubmissionWatcher.h"
+#include "TokenIndex.h"
+#include "WorkdirPool.h"
+#ifndef _WIN32
+#endif
 using namespace std;
 namespace fs = filesystem;
-plog::ColorConsoleAppender<plog::TxtFormatter> appender;
+plog::ColorConsoleAppender<plog::TxtFormatter> console;
+OrderedAppender appender(console);
 #ifdef _WIN32
 BOOL WINAPI SignalHandler(DWORD) {
   fn();
@@ -117,6 +133,9 @@ void parseSettingsFormat(const std::string_view sv, Testcases &tc) {
   throw std::runtime_error("File format not implemented");
 }
 int main(int argc, char **argv) {
+  // A helper started by CheckerPool, not a judging session
+  if (argc == 2 && std::string_view(argv[1]) == "--checker-host")
+    return checker_host_main(0);
 #ifdef _WIN32
   // Set output code page to UTF-8
   SetConsoleOutputCP(CP_UTF8);
@@ -125,6 +144,9 @@ int main(int argc, char **argv) {
   plog::init(plog::verbose, &appender);
   fs::path subdir, tdir, compfile, judgers = "judgers";
   bool waitSubmittorMode = false;
+  int jobs = 1;
+  int compileJobs = 0;
+  int queueDepth = 0;
   CLI::App app{"competitive programming judger"};
   argv = app.ensure_utf8(argv);
 
@@ -150,6 +172,22 @@ int main(int argc, char **argv) {
   mode->add_flag("-w,--wait-submittor-mode", waitSubmittorMode,
                  "Wait for new submissions instead of exiting");
 
+  auto *perf = app.add_option_group("Performance");
+  perf->add_option("--jobs", jobs, "Judge N submissions at the same time")
+      ->option_text("N")
+      ->check(CLI::PositiveNumber);
+  perf->add_option("--compile-jobs", compileJobs,
+                   "Compile upcoming submissions in N threads of their own "
+                   "while --jobs threads run the tests (0: each job compiles "
+                   "its own)")
+      ->option_text("N")
+      ->check(CLI::NonNegativeNumber);
+  perf->add_option("--queue-depth", queueDepth,
+                   "Compiled submissions that may wait for a test thread "
+                   "(default: --jobs)")
+      ->option_text("N")
+      ->check(CLI::NonNegativeNumber);
+
   app.get_formatter()->column_width(32);
   try {
     app.parse(argc, argv);
@@ -158,6 +196,13 @@ int main(int argc, char **argv) {
     return app.exit(e);
   }
 
+#ifndef _WIN32
+  // The judger moves into its own leaf before it starts anything (checker
+  // hosts, watcher threads) that would otherwise pin the delegated parent
+  if (!CgroupLeaf::init())
+    PLOGW << "cgroup v2 unusable, limits fall back to setrlimit()";
+#endif
+
   subdir = fs::canonical(subdir);
   tdir = fs::canonical(tdir);
   if (!compfile.empty())
@@ -207,6 +252,31 @@ int main(int argc, char **argv) {
         globalInfo);
 #endif
   }
+  CoreAllocator::instance().configure(
+      parse_core_policy(globalInfo.environment.corePolicy));
+  if (CoreAllocator::instance().capacity())
+    PLOGI << "pinning test runs to " << CoreAllocator::instance().capacity()
+          << " exclusive CPUs (" << globalInfo.environment.corePolicy << ")";
+  WorkdirPool::instance().configure(
+      fs::path(globalInfo.environment.contestHouse) / "judgeWORK",
+      (uint64_t)std::max(globalInfo.environment.workdirQuota, 0) << 20);
+  if (globalInfo.environment.workdirQuota > 0 &&
+      !WorkdirPool::instance().mounted())
+    PLOGW << "cannot mount tmpfs workdirs (needs CAP_SYS_ADMIN on Linux); "
+             "WorkdirQuota has no effect and output can fill the disk";
+  if (globalInfo.environment.compileCache)
+    CompileCache::instance().configure(
+        fs::path(globalInfo.environment.contestHouse) / "judgeCACHE");
+  if (globalInfo.environment.tokenIndex)
+    TokenIndex::configure(fs::path(globalInfo.environment.contestHouse) /
+                          "judgeCACHE" / "index");
+  CheckerPool::instance().configure(
+      globalInfo.environment.checkerHosts,
+      globalInfo.environment.checkerTimeLimit,
+      (uint64_t)std::max(globalInfo.environment.checkerMemoryLimit, 0) << 20);
+  if (CheckerPool::instance().enabled())
+    PLOGI << "running evaluators in " << globalInfo.environment.checkerHosts
+          << " checker host(s)";
   // discover TCs
   unordered_map<string, Testcases> testcases;
   for (auto &fd : fs::directory_iterator(tdir)) {
@@ -288,13 +358,121 @@ int main(int argc, char **argv) {
       }
     }
   }
+  // Resolve every evaluator once, up front, so a broken one shows at startup.
+  // The stock ones are built in and never loaded
+  for (const auto &[name, tests] : testcases) {
+    if (builtin_checker(tests.EvaluatorName) != BuiltinChecker::None)
+      continue;
+    try {
+      EvaluatorRegistry::instance().get(judgers / tests.EvaluatorName);
+    } catch (const std::exception &e) {
+      PLOGE << name << ": cannot load evaluator " << tests.EvaluatorName
+            << " (" << e.what() << ")";
+    }
+  }
+  PLOGI << EvaluatorRegistry::instance().size() << " evaluator(s) loaded";
+
+  // Digest every expected output checked by a built-in once, instead of
+  // every submission re-reading it
+  if (TokenIndex::enabled()) {
+    std::size_t indexed = 0, failed = 0;
+    for (const auto &[name, tests] : testcases) {
+      BuiltinChecker policy = builtin_checker(tests.EvaluatorName);
+      if (policy != BuiltinChecker::Tokens &&
+          policy != BuiltinChecker::LinesWords)
+        continue;
+      for (const auto &tc : tests.subtests)
+        for (const auto &file : split_output_files(tests.OutputFile))
+          ++(TokenIndex::prepare(tdir / name / tc.Name / file, policy)
+                 ? indexed
+                 : failed);
+    }
+    if (indexed || failed)
+      PLOGI << indexed << " expected output(s) indexed, " << failed
+            << " left to be read in full";
+  }
+
+  // Numbered in serial order up front, so --jobs doesn't change the reports
+  struct Job {
+    std::string user, problem;
+    int index;
+  };
+  std::vector<Job> queue;
   for (auto &user : fs::directory_iterator(subdir)) {
     if (!user.is_directory())
       continue;
-    for (auto &problem : testcases) {
-      judge(subdir, tdir, problem.first, user.path().stem().string(),
-            globalInfo, testcases, judgers);
-    }
+    for (auto &problem : testcases)
+      queue.push_back(
+          {user.path().stem().string(), problem.first, next_judge_index()});
+  }
+  if (jobs > 1 && !CoreAllocator::instance().capacity())
+    PLOGW << "judging " << jobs << " submissions at once without a "
+          << "CorePolicy; test runs will compete for CPUs";
+  if (jobs > 1 && !queue.empty())
+    appender.start(queue.front().index);
+  std::atomic<std::size_t> next{0};
+  std::vector<std::thread> workers;
+  if (compileJobs > 0) {
+    // Compile stage -> bounded queue -> test stage: the next submissions
+    // compile while the current ones are tested
+    BoundedQueue<std::pair<int, std::shared_ptr<CompiledSubmission>>>
+        compiled(queueDepth > 0 ? queueDepth : jobs);
+    std::atomic<int> compiling{compileJobs};
+    auto compile_stage = [&] {
+      for (std::size_t i; (i = next++) < queue.size();) {
+        std::shared_ptr<CompiledSubmission> submission;
+        {
+          OrderedAppender::Scope scope(queue[i].index);
+          submission =
+              compile_submission(subdir, tdir, queue[i].problem,
+                                 queue[i].user, globalInfo, testcases,
+                                 queue[i].index);
+        }
+        if (!submission) {
+          appender.finish(queue[i].index);
+          continue;
+        }
+        compiled.push({queue[i].index, std::move(submission)});
+        PLOGD << "test queue depth " << compiled.size() << "/"
+              << compiled.capacity();
+      }
+      if (--compiling == 0)
+        compiled.close();
+    };
+    auto test_stage = [&] {
+      while (auto submission = compiled.pop()) {
+        {
+          OrderedAppender::Scope scope(submission->first);
+          test_submission(*submission->second, judgers);
+        }
+        appender.finish(submission->first);
+      }
+    };
+    for (int i = 0; i < compileJobs; ++i)
+      workers.emplace_back(compile_stage);
+    for (int i = 1; i < jobs; ++i)
+      workers.emplace_back(test_stage);
+    test_stage();
+    for (auto &t : workers)
+      t.join();
+    PLOGI << "test queue peak depth " << compiled.peak() << "/"
+          << compiled.capacity();
+  } else {
+    auto worker = [&] {
+      for (std::size_t i; (i = next++) < queue.size();) {
+        {
+          OrderedAppender::Scope scope(queue[i].index);
+          judge(subdir, tdir, queue[i].problem, queue[i].user, globalInfo,
+                testcases, judgers, queue[i].index);
+        }
+        appender.finish(queue[i].index);
+      }
+    };
+    for (int i = 1; i < jobs && i < (int)queue.size(); ++i)
+      workers.emplace_back(worker);
+    worker();
+    for (auto &t : workers)
+      t.join();
   }
   auto print_stats = [&]() {
     auto scores = getScores();
@@ -401,7 +579,7 @@ int main(int argc, char **argv) {
     auto callback_judge = [&](fs::path path) -> void {
       judge(subdir, tdir, path.filename().stem().string(),
             path.parent_path().filename().string(), globalInfo, testcases,
-            judgers);
+            judgers, next_judge_index());
       print_stats();
     };
     SubmissionWatcher watcher(subdir, callback_judge);
@@ -296,6 +296,7 @@ void ParseGlobalOptions<ParseType::XML>(const std::string_view &xml,
       CompilerItem ci;
       ci.ext = attr_str(item, "ext");
       ci.cmd = attr_str(item, "cmd");
+      ci.security = attr_str(item, "security");
 
       out.compiler.items.push_back(std::move(ci));
     }
@@ -314,6 +315,26 @@ void ParseGlobalOptions<ParseType::XML>(const std::string_view &xml,
     env->QueryBoolAttribute("ActiveSecurity", &out.environment.activeSecurity);
     env->QueryIntAttribute("ExamEditAction", &out.environment.examEditAction);
     env->QueryBoolAttribute("ToolBarVisible", &out.environment.toolBarVisible);
+    env->QueryBoolAttribute("CountInstructions",
+                            &out.environment.countInstructions);
+    env->QueryDoubleAttribute("InstructionsPerSecond",
+                              &out.environment.instructionsPerSecond);
+    if (const char *policy = env->Attribute("CorePolicy"))
+      out.environment.corePolicy = policy;
+    env->QueryFloatAttribute("IdleLimit", &out.environment.idleLimit);
+    env->QueryIntAttribute("MaxProcesses", &out.environment.maxProcesses);
+    env->QueryIntAttribute("CompileMaxProcesses",
+                           &out.environment.compileMaxProcesses);
+    env->QueryIntAttribute("WorkdirQuota", &out.environment.workdirQuota);
+    env->QueryIntAttribute("ParallelSubtests",
+                           &out.environment.parallelSubtests);
+    env->QueryBoolAttribute("CompileCache", &out.environment.compileCache);
+    env->QueryIntAttribute("CheckerHosts", &out.environment.checkerHosts);
+    env->QueryFloatAttribute("CheckerTimeLimit",
+                             &out.environment.checkerTimeLimit);
+    env->QueryIntAttribute("CheckerMemoryLimit",
+                           &out.environment.checkerMemoryLimit);
+    env->QueryBoolAttribute("TokenIndex", &out.environment.tokenIndex);
   }
 }
 
@@ -389,6 +410,7 @@ void ParseGlobalOptions<ParseType::YAML>(const std::string_view &sv,
         CompilerItem ci;
         ci.ext = item["ext"].as<std::string>();
         ci.cmd = item["cmd"].as<std::string>();
+        ci.security = item["security"].as<std::string>("");
         out.compiler.items.push_back(std::move(ci));
       }
     }
@@ -409,6 +431,24 @@ void ParseGlobalOptions<ParseType::YAML>(const std::string_view &sv,
         env["LastContestantDir"].as<std::string>();
     out.environment.examEditAction = env["ExamEditAction"].as<int>();
     out.environment.toolBarVisible = env["ToolBarVisible"].as<bool>();
+    out.environment.countInstructions =
+        env["CountInstructions"].as<bool>(false);
+    out.environment.instructionsPerSecond =
+        env["InstructionsPerSecond"].as<double>(1e9);
+    out.environment.corePolicy =
+        env["CorePolicy"].as<std::string>(out.environment.corePolicy);
+    out.environment.idleLimit = env["IdleLimit"].as<float>(0);
+    out.environment.maxProcesses = env["MaxProcesses"].as<int>(64);
+    out.environment.compileMaxProcesses =
+        env["CompileMaxProcesses"].as<int>(0);
+    out.environment.workdirQuota = env["WorkdirQuota"].as<int>(0);
+    out.environment.parallelSubtests = env["ParallelSubtests"].as<int>(1);
+    out.environment.compileCache = env["CompileCache"].as<bool>(false);
+    out.environment.checkerHosts = env["CheckerHosts"].as<int>(0);
+    out.environment.checkerTimeLimit = env["CheckerTimeLimit"].as<float>(10);
+    out.environment.checkerMemoryLimit =
+        env["CheckerMemoryLimit"].as<int>(1024);
+    out.environment.tokenIndex = env["TokenIndex"].as<bool>(false);
   }
 }
 
@@ -500,6 +540,7 @@ void ParseGlobalOptions<ParseType::TOML>(const std::string_view &sv,
 
           item.ext = itbl.at("ext").value_or("");
           item.cmd = itbl.at("cmd").value_or("");
+          item.security = itbl["security"].value_or("");
 
           cc.items.push_back(std::move(item));
         }
@@ -529,6 +570,24 @@ void ParseGlobalOptions<ParseType::TOML>(const std::string_view &sv,
       env.lastContestantDir = tbl.at("LastContestantDir").value_or("");
       env.examEditAction = tbl.at("ExamEditAction").value_or(0);
       env.toolBarVisible = tbl.at("ToolBarVisible").value_or(true);
+      env.countInstructions = tbl["CountInstructions"].value_or(false);
+      env.instructionsPerSecond =
+          tbl["InstructionsPerSecond"].value_or(env.instructionsPerSecond);
+      env.corePolicy = tbl["CorePolicy"].value_or(env.corePolicy);
+      env.idleLimit = tbl["IdleLimit"].value_or(env.idleLimit);
+      env.maxProcesses = tbl["MaxProcesses"].value_or(env.maxProcesses);
+      env.compileMaxProcesses =
+          tbl["CompileMaxProcesses"].value_or(env.compileMaxProcesses);
+      env.workdirQuota = tbl["WorkdirQuota"].value_or(env.workdirQuota);
+      env.parallelSubtests =
+          tbl["ParallelSubtests"].value_or(env.parallelSubtests);
+      env.compileCache = tbl["CompileCache"].value_or(env.compileCache);
+      env.checkerHosts = tbl["CheckerHosts"].value_or(env.checkerHosts);
+      env.checkerTimeLimit =
+          tbl["CheckerTimeLimit"].value_or(env.checkerTimeLimit);
+      env.checkerMemoryLimit =
+          tbl["CheckerMemoryLimit"].value_or(env.checkerMemoryLimit);
+      env.tokenIndex = tbl["TokenIndex"].value_or(env.tokenIndex);
 
       out.environment = env;
     }
@@ -621,6 +680,7 @@ void ParseGlobalOptions<ParseType::JSON>(const std::string_view &text,
         CompilerItem ci;
         ci.ext = item.value("ext", "");
         ci.cmd = item.value("cmd", "");
+        ci.security = item.value("security", "");
 
         out.compiler.items.push_back(std::move(ci));
       }
@@ -645,5 +705,20 @@ void ParseGlobalOptions<ParseType::JSON>(const std::string_view &text,
     e.activeSecurity = env.value("ActiveSecurity", false);
     e.examEditAction = env.value("ExamEditAction", 0);
     e.toolBarVisible = env.value("ToolBarVisible", true);
+    e.countInstructions = env.value("CountInstructions", false);
+    e.instructionsPerSecond = env.value("InstructionsPerSecond", 1e9);
+    e.corePolicy = env.value("CorePolicy", e.corePolicy);
+    e.idleLimit = env.value("IdleLimit", e.idleLimit);
+    e.maxProcesses = env.value("MaxProcesses", e.maxProcesses);
+    e.compileMaxProcesses =
+        env.value("CompileMaxProcesses", e.compileMaxProcesses);
+    e.workdirQuota = env.value("WorkdirQuota", e.workdirQuota);
+    e.parallelSubtests = env.value("ParallelSubtests", e.parallelSubtests);
+    e.compileCache = env.value("CompileCache", e.compileCache);
+    e.checkerHosts = env.value("CheckerHosts", e.checkerHosts);
+    e.checkerTimeLimit = env.value("CheckerTimeLimit", e.checkerTimeLimit);
+    e.checkerMemoryLimit =
+        env.value("CheckerMemoryLimit", e.checkerMemoryLimit);
+    e.tokenIndex = env.value("TokenIndex", e.tokenIndex);
   }
 }
\ No newline at end of file
@@ -0,0 +1,73 @@
+// Spawn latency against judger heap size.
+//
+// Grows a touched heap to each size given on the command line (MiB) and times
+// a fork()+execve() baseline against run_command()'s clone(CLONE_VM |
+// CLONE_VFORK) path, both running /bin/true. fork() copies the page tables of
+// the whole heap, so its cost climbs with RSS while run_command()'s should
+// stay flat.
+//
+//   spawn_bench [iterations] [MiB...]    (default: 200 0 64 256 1024)
+#include "ProcessIO.h"
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using clk = std::chrono::steady_clock;
+
+static double fork_exec_us(int iterations) {
+#ifdef _WIN32
+  (void)iterations;
+  return 0.0;
+#else
+  auto start = clk::now();
+  for (int i = 0; i < iterations; ++i) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      execl("/bin/true", "true", (char *)nullptr);
+      _exit(127);
+    }
+    waitpid(pid, nullptr, 0);
+  }
+  return std::chrono::duration<double, std::micro>(clk::now() - start)
+             .count() /
+         iterations;
+#endif
+}
+
+static double run_command_us(int iterations) {
+  RunOptions options;
+  options.maxMemory = 0;
+  auto start = clk::now();
+  for (int i = 0; i < iterations; ++i)
+    run_command({"/bin/true"}, ".", options);
+  return std::chrono::duration<double, std::micro>(clk::now() - start)
+             .count() /
+         iterations;
+}
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 200;
+  std::vector<size_t> sizes;
+  for (int i = 2; i < argc; ++i)
+    sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+  if (sizes.empty())
+    sizes = {0, 64, 256, 1024};
+
+  std::vector<char> heap;
+  std::cout << std::setw(10) << "heap MiB" << std::setw(16) << "fork+exec us"
+            << std::setw(16) << "run_command us" << "\n";
+  for (size_t mib : sizes) {
+    heap.resize(mib << 20);
+    for (size_t i = 0; i < heap.size(); i += 4096)
+      heap[i] = 1; // make every page resident
+    std::cout << std::setw(10) << mib << std::setw(16) << std::fixed
+              << std::setprecision(1) << fork_exec_us(iterations)
+              << std::setw(16) << run_command_us(iterations) << std::endl;
+  }
+}
@@ -0,0 +1,62 @@
+// Contestant stand-in for the run tests: argv[1] picks what it does.
+//   echo TEXT  - prints TEXT and exits
+//   cat        - copies stdin to stdout
+//   wrong      - prints a wrong answer, then sleeps without using CPU
+//   sleep      - sleeps without using CPU
+//   socket     - makes a system call the Native seccomp profile forbids
+//   ioctl      - tries FIOASYNC (off the Native list) and FIONREAD (on it)
+//                on stdout and prints which of them worked
+//   spam       - writes to stdout forever
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+  if (argc < 2)
+    return 2;
+  if (!strcmp(argv[1], "echo") && argc > 2) {
+    fputs(argv[2], stdout);
+    return 0;
+  }
+  if (!strcmp(argv[1], "cat")) {
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(0, buf, sizeof(buf))) > 0)
+      if (fwrite(buf, 1, (size_t)n, stdout) != (size_t)n)
+        return 1;
+    return 0;
+  }
+  if (!strcmp(argv[1], "wrong")) {
+    puts("wrong");
+    fflush(stdout);
+    sleep(30);
+    return 0;
+  }
+  if (!strcmp(argv[1], "sleep")) {
+    sleep(30);
+    return 0;
+  }
+  if (!strcmp(argv[1], "socket")) {
+    socket(AF_INET, SOCK_STREAM, 0);
+    return 0;
+  }
+  if (!strcmp(argv[1], "ioctl")) {
+    int on = 1, pending;
+    int async = ioctl(1, FIOASYNC, &on) == 0 || errno != ENOTTY;
+    int nread = ioctl(1, FIONREAD, &pending) == 0;
+    printf("%s %s", async ? "allowed" : "denied",
+           nread ? "allowed" : "denied");
+    return 0;
+  }
+  if (!strcmp(argv[1], "spam")) {
+    static char line[4096];
+    memset(line, 'x', sizeof(line));
+    for (;;)
+      fwrite(line, 1, sizeof(line), stdout);
+  }
+  return 2;
+}
@@ -0,0 +1,25 @@
+// Evaluator for the checker host tests; testName picks what it does:
+//   flaky - crashes if <contestantsDir>/crash-once exists, removing it first
+//   crash - always crashes
+//   anything else - full points
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+double Judge(char *contestantsDir, char *testsDir, char *testOutputs,
+             char *testName, char **comments) {
+  (void)testsDir;
+  (void)testOutputs;
+  *comments = NULL;
+  if (!strcmp(testName, "crash"))
+    abort();
+  if (!strcmp(testName, "flaky")) {
+    char marker[PATH_MAX];
+    snprintf(marker, sizeof(marker), "%s/crash-once", contestantsDir);
+    if (unlink(marker) == 0)
+      abort();
+  }
+  return 1.0;
+}
@@ -0,0 +1,487 @@
+// Checks of the pieces a verdict is made of, one group per ctest test:
+//   judger_tests <group>
+// FIXTURE, JUDGE_LIB, C1_LIB and FLAKY_CHECKER are the paths of the test
+// programs and libraries, set by CMake.
+#include "CheckerHost.h"
+#include "Comparators.h"
+#include "CompileCache.h"
+#include "JudgeAPI.h"
+#include "ProcessIO.h"
+#include "TokenIndex.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+namespace {
+int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ")\n";     \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+fs::path scratch() {
+  static fs::path dir = [] {
+    fs::path d = fs::temp_directory_path() /
+                 ("judger_tests-" + std::to_string(getpid()));
+    fs::create_directories(d);
+    return d;
+  }();
+  return dir;
+}
+
+void write_file(const fs::path &path, std::string_view data) {
+  std::ofstream(path, std::ios::binary | std::ios::trunc)
+      .write(data.data(), data.size());
+}
+
+std::string read_file(const fs::path &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+// The CPError run_command() throws, "" when the run is accepted
+template <class Fn> std::string verdict(Fn run) {
+  try {
+    run();
+    return "";
+  } catch (const CPError<CPErrors::TLE> &) {
+    return "TLE";
+  } catch (const CPError<CPErrors::OLE> &) {
+    return "OLE";
+  } catch (const CPError<CPErrors::MLE> &) {
+    return "MLE";
+  } catch (const CPError<CPErrors::RF> &) {
+    return "RF";
+  } catch (const CPError<CPErrors::WA> &) {
+    return "WA";
+  } catch (const CPError<CPErrors::ILE> &) {
+    return "ILE";
+  } catch (const CPErrorBase &e) {
+    return e.what();
+  }
+}
+
+std::string run_fixture(const std::vector<std::string> &args,
+                        RunOptions options) {
+  std::vector<std::string> command = {FIXTURE};
+  command.insert(command.end(), args.begin(), args.end());
+  return verdict([&] { run_command(command, scratch(), options); });
+}
+
+double seconds_since(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       begin)
+      .count();
+}
+
+// Outputs made of the pieces the built-ins treat specially: case, BOM,
+// blank lines, CR, runs of whitespace
+std::mt19937 rng(20240611);
+std::string random_text(int pieces) {
+  static const char *alphabet[] = {"a",  "A",      "b",    " ",
+                                   "\n", "\t",     "\r\n", "\xEF\xBB\xBF",
+                                   "ab", "  \n\n"};
+  std::string s;
+  for (int i = 0; i < pieces; ++i)
+    s += alphabet[rng() % 10];
+  return s;
+}
+
+// `expected` and, most of the time, something close to it
+std::pair<std::string, std::string> random_pair() {
+  int pieces = rng() % 12;
+  std::string expected = random_text(pieces);
+  std::string output = rng() % 3 ? expected : random_text(pieces);
+  if (rng() % 4 == 0)
+    for (char &c : output)
+      if (c == 'a')
+        c = 'A';
+  if (rng() % 5 == 0 && !output.empty())
+    output.insert(rng() % output.size(), random_text(1));
+  return {expected, output};
+}
+
+// Feeds `output` in chunks of random size
+bool compare(OutputComparator &comparator, std::string_view output) {
+  while (!output.empty()) {
+    std::size_t n = std::min<std::size_t>(output.size(), 1 + rng() % 7);
+    if (!comparator.feed(output.substr(0, n)))
+      return false;
+    output.remove_prefix(n);
+  }
+  return comparator.finish();
+}
+
+void test_runs() {
+  RunOptions options;
+  options.time = 5;
+  auto echoed = run_command({FIXTURE, "echo", "42"}, scratch(), options);
+  CHECK(echoed.exit_code == 0);
+  CHECK(echoed.stdout_data == "42");
+
+  // The wall-clock limit ends a run that never exits
+  RunOptions brief = options;
+  brief.time = 0.3f;
+  auto begin = std::chrono::steady_clock::now();
+  CHECK(run_fixture({"sleep"}, brief) == "TLE");
+  CHECK(seconds_since(begin) < 3);
+}
+
+void test_stdin() {
+  // Far more than a pipe holds in either direction: feeding stdin and
+  // draining stdout have to happen together
+  std::string input;
+  for (int i = 0; input.size() < 4 * 1024 * 1024; ++i)
+    input += std::to_string(i) + '\n';
+  RunOptions options;
+  options.time = 10;
+  options.stdin_data = input;
+  auto echoed = run_command({FIXTURE, "cat"}, scratch(), options);
+  CHECK(echoed.stdout_data == input);
+}
+
+void test_redirect() {
+  RunOptions options;
+  options.time = 5;
+
+  // Pipe and file output agree
+  auto piped = run_command({FIXTURE, "echo", "1 2 3"}, scratch(), options);
+  CHECK(piped.stdout_data == "1 2 3");
+  RunOptions toFile = options;
+  toFile.stdout_file = scratch() / "run.out";
+  CHECK(run_fixture({"echo", "1 2 3"}, toFile) == "");
+  CHECK(read_file(toFile.stdout_file) == "1 2 3");
+
+  // A file as stdin, a file as stdout
+  write_file(scratch() / "run.inp", "4 5\n6\n");
+  RunOptions files = toFile;
+  files.stdin_file = scratch() / "run.inp";
+  CHECK(run_fixture({"cat"}, files) == "");
+  CHECK(read_file(files.stdout_file) == "4 5\n6\n");
+
+  // Output limit on a file: SIGXFSZ
+  RunOptions limited = toFile;
+  limited.maxOutputBytes = 64 * 1024;
+  CHECK(run_fixture({"spam"}, limited) == "OLE");
+  limited.stdout_file.clear();
+  CHECK(run_fixture({"spam"}, limited) == "OLE");
+}
+
+void test_seccomp() {
+  RunOptions options;
+  options.time = 5;
+  CHECK(run_command({FIXTURE, "ioctl"}, scratch(), options).stdout_data ==
+        "allowed allowed");
+
+  // Forbidden system call: SIGSYS from the seccomp filter
+  RunOptions sandboxed = options;
+  sandboxed.seccomp = SeccompProfile::Native;
+  CHECK(run_fixture({"echo", "ok"}, sandboxed) == "");
+  CHECK(run_fixture({"socket"}, sandboxed) == "RF");
+
+  // ioctl() requests off the list fail with ENOTTY instead of killing
+  CHECK(run_command({FIXTURE, "ioctl"}, scratch(), sandboxed).stdout_data ==
+        "denied allowed");
+}
+
+void test_streaming() {
+  // Tokens in the first bytes and past kMaxToken are where streaming differs
+  // from having the whole output
+  std::string longToken(TokenComparator::kMaxToken + 10, 'x');
+  std::vector<std::pair<std::string, std::string>> cases = {
+      {longToken, longToken.substr(0, TokenComparator::kMaxToken) + "y"},
+      {"\xEF\xBB", "\xEF\xBB"},
+      {"", "\xEF\xBB\xBF"}};
+  for (int i = 0; i < 5000; ++i)
+    cases.push_back(random_pair());
+  fs::path expected = scratch() / "expected.txt";
+  for (const auto &[e, o] : cases) {
+    write_file(expected, e);
+    TokenComparator comparator(expected, true);
+    CHECK(compare(comparator, o) ==
+          builtin_check(BuiltinChecker::Tokens, e, o));
+  }
+
+  // A streamed mismatch ends the run right away
+  write_file(expected, "right\n");
+  TokenComparator tokens(expected, true);
+  RunOptions streamed;
+  streamed.time = 5;
+  streamed.comparator = &tokens;
+  auto begin = std::chrono::steady_clock::now();
+  CHECK(run_fixture({"wrong"}, streamed) == "WA");
+  CHECK(seconds_since(begin) < 3);
+}
+
+void test_idle() {
+  // Idle: stopped after idleTimeout, not the wall-clock limit
+  RunOptions idle;
+  idle.time = 5;
+  idle.idleTimeout = 0.3f;
+  auto begin = std::chrono::steady_clock::now();
+  CHECK(run_fixture({"sleep"}, idle) == "ILE");
+  CHECK(seconds_since(begin) < 3);
+}
+
+void test_compile_cache() {
+  fs::path alice = scratch() / "alice", bob = scratch() / "bob";
+  fs::path work1 = scratch() / "work1", work2 = scratch() / "work2";
+  for (const auto &dir : {alice, bob, work1, work2})
+    fs::create_directories(dir);
+  write_file(alice / "A.cpp", "int main() { x }");
+  write_file(bob / "A.cpp", "int main() { x }");
+
+  CompileCache &cache = CompileCache::instance();
+  cache.configure(scratch() / "cache");
+  std::string key = CompileCache::key(alice / "A.cpp", {"c++", "A.cpp"},
+                                      work1);
+  CHECK(key == CompileCache::key(bob / "A.cpp", {"c++", "A.cpp"}, work2));
+  CHECK(key != CompileCache::key(bob / "A.cpp", {"c++", "-O2", "A.cpp"},
+                                 work2));
+
+  // A compile error names the submitter's own files, whoever compiled first
+  ProcessResult error{};
+  error.exit_code = 1;
+  error.stderr_data = (alice / "A.cpp").string() + ":1: 100% wrong\n" +
+                      (work1 / "a.o").string() + " in " + alice.string();
+  write_file(work1 / "a.o", "");
+  cache.store(key, work1, alice / "A.cpp", error);
+  ProcessResult hit{};
+  CHECK(cache.lookup(key, work2, bob / "A.cpp", hit));
+  CHECK(hit.exit_code == 1);
+  CHECK(hit.stderr_data == (bob / "A.cpp").string() + ":1: 100% wrong\n" +
+                               (work2 / "a.o").string() + " in " +
+                               bob.string());
+  CHECK(fs::exists(work2 / "a.o"));
+  cache.configure({});
+}
+
+void test_checker_hosts() {
+  CheckerPool &pool = CheckerPool::instance();
+  pool.configure(1, 5, 0);
+  CheckRequest request;
+  request.contestantsDir = scratch().string();
+  request.testName = "flaky";
+
+  // A crash is retried on a fresh host...
+  write_file(scratch() / "crash-once", "");
+  auto passed = pool.judge(FLAKY_CHECKER, request);
+  CHECK(passed.points == 1.0);
+  CHECK(!fs::exists(scratch() / "crash-once"));
+
+  // ...and only a second one in a row is the checker's fault
+  request.testName = "crash";
+  std::string failed =
+      verdict([&] { pool.judge(FLAKY_CHECKER, request); });
+  CHECK(failed.find("twice in a row") != std::string::npos);
+  request.testName = "fine";
+  CHECK(pool.judge(FLAKY_CHECKER, request).points == 1.0);
+}
+
+// Checks `expected` and `output` as the judger would with `evaluator`
+double judge_files(const fs::path &evaluator, const std::string &expected,
+                   const std::string &output,
+                   std::string *comments = nullptr) {
+  fs::path tests = scratch() / "checker-tests",
+           contestant = scratch() / "checker-contestant";
+  fs::create_directories(tests);
+  fs::create_directories(contestant);
+  write_file(tests / "t.out", expected);
+  write_file(contestant / "t.out", output);
+  write_file(tests / "t.inp", "");
+
+  CheckRequest request;
+  request.contestantsDir = contestant.string();
+  request.testsDir = tests.string();
+  request.testOutputs = "t.out";
+  request.testName = "t";
+  request.input = tests / "t.inp";
+  request.expected = tests / "t.out";
+  request.output = contestant / "t.out";
+  std::string text;
+  double points = call_evaluator(EvaluatorRegistry::instance().get(evaluator),
+                                 request, text);
+  if (comments)
+    *comments = std::move(text);
+  return points;
+}
+
+void test_builtins() {
+  CHECK(builtin_check(BuiltinChecker::Tokens, "1 2\n3", "1\n2   3\n"));
+  CHECK(builtin_check(BuiltinChecker::Tokens, "\xEF\xBB\xBFYes", "yES"));
+  CHECK(!builtin_check(BuiltinChecker::Tokens, "1 2", "1 2 3"));
+  CHECK(!builtin_check(BuiltinChecker::Tokens, "12", "1 2"));
+  CHECK(builtin_check(BuiltinChecker::LinesWords, "a  b\nc\n", "a b \nc"));
+  CHECK(builtin_check(BuiltinChecker::LinesWords, "a\n", "a\n\n\n"));
+  CHECK(!builtin_check(BuiltinChecker::LinesWords, "a b\nc", "a\nb c"));
+  CHECK(!builtin_check(BuiltinChecker::LinesWords, "a\nb", "a"));
+  CHECK(!builtin_check(BuiltinChecker::LinesWords, "a", "A"));
+  CHECK(builtin_check(BuiltinChecker::Exact, "a b\n", "a b\n"));
+  CHECK(!builtin_check(BuiltinChecker::Exact, "a b\n", "a b"));
+  CHECK(builtin_checker("libC1LinesWordsIgnoreCase.so") ==
+        BuiltinChecker::Tokens);
+  CHECK(builtin_checker("C2LinesWordsCase.dll") == BuiltinChecker::LinesWords);
+  CHECK(builtin_checker("Exact") == BuiltinChecker::Exact);
+  CHECK(builtin_checker("libjudge.so") == BuiltinChecker::None);
+
+  // The built-in Tokens against the library it stands in for (Judge())
+  for (int i = 0; i < 500; ++i) {
+    auto [e, o] = random_pair();
+    CHECK((judge_files(C1_LIB, e, o) == 1.0) ==
+          builtin_check(BuiltinChecker::Tokens, e, o));
+  }
+}
+
+void test_checker_abi() {
+  // JudgeV2() of the stock judge library, which compares lines of
+  // case-folded words, against LinesWords on outputs where the two rules
+  // agree: lower case, no blank lines
+  auto lines = [](int count) {
+    static const char *words[] = {"a", "b", "ab", "ba"};
+    std::string s;
+    for (int l = 0; l < count; ++l) {
+      for (int w = 0, n = 1 + rng() % 3; w < n; ++w)
+        s += std::string(words[rng() % 4]) + (rng() % 3 ? " " : " \t ");
+      s += rng() % 4 ? "\n" : "\r\n";
+    }
+    return s;
+  };
+  CHECK(EvaluatorRegistry::instance().get(JUDGE_LIB).judgeV2);
+  for (int i = 0; i < 500; ++i) {
+    int count = 1 + rng() % 4;
+    std::string e = lines(count), o = rng() % 3 ? e : lines(count);
+    if (rng() % 4 == 0)
+      o.pop_back(); // the last line's terminator
+    CHECK((judge_files(JUDGE_LIB, e, o) == 1.0) ==
+          builtin_check(BuiltinChecker::LinesWords, e, o));
+  }
+
+  // Comments in the shape Judge() gives them
+  std::string comments;
+  CHECK(judge_files(JUDGE_LIB, "a b\n", "A b\n", &comments) == 1.0);
+  CHECK(comments == "t: PASSED\n");
+  CHECK(judge_files(JUDGE_LIB, "a b\n", "a\n", &comments) == 0.0);
+  CHECK(comments == "t: FAILED\n");
+}
+
+void test_token_index() {
+  fs::path tests = scratch() / "tests", cache = scratch() / "index";
+  fs::create_directories(tests);
+  fs::path expected = tests / "answer.out";
+
+  // Off until configured
+  write_file(expected, "1 2 3\n");
+  CHECK(!TokenIndex::enabled());
+  CHECK(!TokenIndex::prepare(expected, BuiltinChecker::Tokens));
+  TokenIndex::configure(cache);
+  CHECK(TokenIndex::enabled());
+  CHECK(!TokenIndex::prepare(expected, BuiltinChecker::Exact));
+
+  for (auto policy : {BuiltinChecker::Tokens, BuiltinChecker::LinesWords})
+    for (int i = 0; i < 2000; ++i) {
+      auto [e, o] = random_pair();
+      write_file(expected, e);
+      fs::remove(TokenIndex::path_for(expected, policy));
+      CHECK(TokenIndex::prepare(expected, policy));
+      auto index = TokenIndex::load(expected, policy);
+      CHECK(index.has_value());
+      if (!index)
+        continue;
+      DigestComparator digest(std::move(*index));
+      CHECK(compare(digest, o) == builtin_check(policy, e, o));
+    }
+
+  // Several blocks; a change in the last one is still caught
+  std::string big;
+  for (int i = 0; big.size() < 3 * CanonicalHasher::kBlock; ++i)
+    big += std::to_string(i) + (i % 10 ? " " : "\n");
+  write_file(expected, big);
+  CHECK(TokenIndex::prepare(expected, BuiltinChecker::Tokens));
+  auto index = TokenIndex::load(expected, BuiltinChecker::Tokens);
+  CHECK(index && index->blocks.size() >= 3);
+  if (index) {
+    DigestComparator same(*index), changed(*index), shorter(*index);
+    std::string wrong = big;
+    wrong[wrong.size() - 3] ^= 1;
+    CHECK(same.feed(big) && same.finish());
+    CHECK(!(changed.feed(wrong) && changed.finish()));
+    CHECK(!(shorter.feed(big.substr(0, big.size() / 2)) && shorter.finish()));
+  }
+
+  // A changed answer makes its sidecar stale; nothing is written next to it
+  write_file(expected, big + "x");
+  CHECK(!TokenIndex::load(expected, BuiltinChecker::Tokens));
+  CHECK(TokenIndex::path_for(expected, BuiltinChecker::Tokens).parent_path() ==
+        cache);
+  CHECK(std::distance(fs::directory_iterator(tests), {}) == 1);
+
+  // Streamed through a run. Blocks are only compared once complete, so a
+  // short output is rejected early only when it outgrows the answer, and
+  // otherwise by finish()
+  write_file(expected, "ok\n");
+  CHECK(TokenIndex::prepare(expected, BuiltinChecker::Tokens));
+  index = TokenIndex::load(expected, BuiltinChecker::Tokens);
+  CHECK(index.has_value());
+  if (index) {
+    DigestComparator longer(*index), reject(*index), accept(*index);
+    RunOptions streamed;
+    streamed.time = 5;
+    streamed.comparator = &longer;
+    auto begin = std::chrono::steady_clock::now();
+    CHECK(run_fixture({"wrong"}, streamed) == "WA");
+    CHECK(seconds_since(begin) < 3);
+    streamed.comparator = &reject;
+    CHECK(run_fixture({"echo", "no"}, streamed) == "");
+    CHECK(!reject.finish());
+    streamed.comparator = &accept;
+    CHECK(run_fixture({"echo", "OK"}, streamed) == "");
+    CHECK(accept.finish());
+  }
+  TokenIndex::configure({});
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  // CheckerPool starts this binary as its hosts
+  if (argc == 2 && std::string_view(argv[1]) == "--checker-host")
+    return checker_host_main(0);
+  std::map<std::string, std::function<void()>> groups = {
+      {"stdin", test_stdin},
+      {"redirect", test_redirect},
+      {"seccomp", test_seccomp},
+      {"streaming", test_streaming},
+      {"idle", test_idle},
+      {"compile_cache", test_compile_cache},
+      {"checker_hosts", test_checker_hosts},
+      {"builtins", test_builtins},
+      {"checker_abi", test_checker_abi},
+      {"token_index", test_token_index},
+      {"runs", test_runs}};
+  if (argc != 2 || !groups.count(argv[1])) {
+    std::cerr << "usage: judger_tests <group>; groups:";
+    for (const auto &group : groups)
+      std::cerr << ' ' << group.first;
+    std::cerr << '\n';
+    return 2;
+  }
+  try {
+    groups[argv[1]]();
+  } catch (const std::exception &e) {
+    std::cerr << "uncaught: " << e.what() << "\n";
+    ++failures;
+  }
+  std::error_code ec;
+  fs::remove_all(scratch(), ec);
+  return failures ? 1 : 0;
+}